@@ -1,5 +1,10 @@
+# an optional fourth argument is passed on as --target-env, e.g. vulkan1.1 for subgroup operations
 function(glsl2spirv glsl header namespace)
     get_filename_component(shader_name ${glsl} NAME)
+    set(target_env)
+    if(ARGC GREATER 3)
+        set(target_env "--target-env" ${ARGV3})
+    endif()
     set(spirv_dir "${CMAKE_CURRENT_BINARY_DIR}/spirv")
     set(spirv_full "${spirv_dir}/${shader_name}.spv")
 
@@ -11,6 +16,7 @@ function(glsl2spirv glsl header namespace)
             ${glsl} 
             "-V"
             "-x"
+            ${target_env}
             "-o" ${spirv_full}
         DEPENDS ${glsl}
         COMMENT "compiling ${glsl}"
@@ -29,7 +35,7 @@ function(glsl2spirv glsl header namespace)
 endfunction()
 
 function(add_spirv_library name)
-    cmake_parse_arguments(add_spirv_library "" "" "GLSL" ${ARGN})
+    cmake_parse_arguments(add_spirv_library "" "TARGET_ENV" "GLSL" ${ARGN})
     set(header_dir "${CMAKE_CURRENT_BINARY_DIR}/${name}")
 
     add_library(${name} INTERFACE)
@@ -41,7 +47,7 @@ function(add_spirv_library name)
         set(header_full "${header_dir}/${file_name}.hpp")
         string(REGEX REPLACE "\\." "_" namespace ${file_name})
 
-        glsl2spirv(${source_full} ${header_full} ${namespace})
+        glsl2spirv(${source_full} ${header_full} ${namespace} ${add_spirv_library_TARGET_ENV})
 
         target_sources(${name} INTERFACE ${header_full})
     endforeach()
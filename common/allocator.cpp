@@ -0,0 +1,289 @@
+#include "allocator.hpp"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+namespace vulkan {
+
+struct memory_block {
+    vk::DeviceMemory memory{};
+    vk::DeviceSize size{};
+    void* mapped{nullptr};
+    std::uint32_t allocations{};
+
+    // offset -> size of every free range
+    std::map<vk::DeviceSize, vk::DeviceSize> free{};
+};
+
+namespace {
+vk::DeviceSize align_up(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+} // namespace
+
+allocation::allocation(allocation&& other) noexcept {
+    *this = std::move(other);
+}
+
+allocation& allocation::operator=(allocation&& other) noexcept {
+    if (this != &other) {
+        release();
+
+        _owner = std::exchange(other._owner, nullptr);
+        _block = std::exchange(other._block, nullptr);
+        _memory = std::exchange(other._memory, nullptr);
+        _offset = std::exchange(other._offset, 0);
+        _size = std::exchange(other._size, 0);
+        _type = std::exchange(other._type, 0);
+        _mapped = std::exchange(other._mapped, nullptr);
+    }
+
+    return *this;
+}
+
+allocation::~allocation() {
+    release();
+}
+
+void allocation::release() {
+    if (_owner) {
+        _owner->free(*this);
+    }
+
+    _owner = nullptr;
+    _block = nullptr;
+    _memory = nullptr;
+    _offset = 0;
+    _size = 0;
+    _mapped = nullptr;
+}
+
+const vk::DeviceMemory& allocation::memory() const {
+    return _memory;
+}
+
+vk::DeviceSize allocation::offset() const {
+    return _offset;
+}
+
+vk::DeviceSize allocation::size() const {
+    return _size;
+}
+
+std::uint32_t allocation::type() const {
+    return _type;
+}
+
+void* allocation::mapped() const {
+    return _mapped;
+}
+
+bool allocation::dedicated() const {
+    return _owner && !_block;
+}
+
+void allocation::flush(vk::DeviceSize offset, vk::DeviceSize size) const {
+    if (_owner && !_owner->coherent(_type)) {
+        _owner->_device.flushMappedMemoryRanges(_owner->mapped_range(*this, offset, size));
+    }
+}
+
+void allocation::invalidate(vk::DeviceSize offset, vk::DeviceSize size) const {
+    if (_owner && !_owner->coherent(_type)) {
+        _owner->_device.invalidateMappedMemoryRanges(_owner->mapped_range(*this, offset, size));
+    }
+}
+
+allocator::allocator(const vk::PhysicalDevice& physical, const vk::Device& logical, vk::DeviceSize block_size)
+    : _device(logical), _props(physical.getMemoryProperties()), _block_size(block_size) {
+    const auto limits = physical.getProperties().limits;
+    _granularity = std::max<vk::DeviceSize>(limits.bufferImageGranularity, 1);
+    _atom_size = std::max<vk::DeviceSize>(limits.nonCoherentAtomSize, 1);
+    _pools.resize(_props.memoryTypeCount);
+}
+
+allocator::~allocator() {
+    for (auto& pool : _pools) {
+        for (auto& block : pool) {
+            _device.freeMemory(block->memory);
+        }
+    }
+}
+
+allocation allocator::allocate(const vk::MemoryRequirements& req, std::uint32_t type, bool dedicated) {
+    std::lock_guard lock{_mutex};
+
+    const auto heap_size = _props.memoryHeaps[_props.memoryTypes[type].heapIndex].size;
+    const auto block_size = std::min(_block_size, align_up(heap_size / 8, _granularity));
+
+    allocation a{};
+    a._type = type;
+
+    if (dedicated || req.size > block_size / 2) {
+        a._memory = _device.allocateMemory(vk::MemoryAllocateInfo{req.size, type});
+        a._size = req.size;
+        a._mapped = map(a._memory, type);
+        a._owner = this;
+
+        ++_dedicated_count;
+        _dedicated_size += req.size;
+
+        return a;
+    }
+
+    // keeping every range on its own granularity page lets buffers and
+    // optimal images share a block without aliasing, non-coherent ranges
+    // are padded to whole atoms so flushes never touch a neighbour
+    const auto page = coherent(type) ? _granularity : std::max(_granularity, _atom_size);
+    const auto alignment = std::max(req.alignment, page);
+    const auto size = align_up(req.size, page);
+
+    auto& pool = _pools[type];
+    for (auto& block : pool) {
+        for (auto it = block->free.begin(); it != block->free.end(); ++it) {
+            const auto [begin, range] = *it;
+            const auto offset = align_up(begin, alignment);
+            if (offset + size > begin + range) {
+                continue;
+            }
+
+            block->free.erase(it);
+            if (offset > begin) {
+                block->free.emplace(begin, offset - begin);
+            }
+            if (offset + size < begin + range) {
+                block->free.emplace(offset + size, begin + range - offset - size);
+            }
+
+            ++block->allocations;
+
+            a._owner = this;
+            a._block = block.get();
+            a._memory = block->memory;
+            a._offset = offset;
+            a._size = size;
+            a._mapped = block->mapped ? static_cast<std::uint8_t*>(block->mapped) + offset : nullptr;
+
+            return a;
+        }
+    }
+
+    auto& block = make_block(type, block_size);
+    block.free.clear();
+    if (size < block.size) {
+        block.free.emplace(size, block.size - size);
+    }
+    ++block.allocations;
+
+    a._owner = this;
+    a._block = &block;
+    a._memory = block.memory;
+    a._offset = 0;
+    a._size = size;
+    a._mapped = block.mapped;
+
+    return a;
+}
+
+void allocator::free(allocation& a) {
+    std::lock_guard lock{_mutex};
+
+    if (!a._block) {
+        _device.freeMemory(a._memory);
+        --_dedicated_count;
+        _dedicated_size -= a._size;
+        return;
+    }
+
+    auto& block = *a._block;
+    auto [it, _] = block.free.emplace(a._offset, a._size);
+
+    const auto next = std::next(it);
+    if (next != block.free.end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        block.free.erase(next);
+    }
+
+    if (it != block.free.begin()) {
+        const auto prev = std::prev(it);
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            block.free.erase(it);
+        }
+    }
+
+    // keep one empty block around to avoid allocation ping-pong
+    auto& pool = _pools[a._type];
+    if (--block.allocations == 0 && pool.size() > 1) {
+        const auto iter = std::find_if(pool.begin(), pool.end(), [&block](const auto& b) {
+            return b.get() == &block;
+        });
+
+        _device.freeMemory(block.memory);
+        pool.erase(iter);
+    }
+}
+
+memory_block& allocator::make_block(std::uint32_t type, vk::DeviceSize size) {
+    auto block = std::make_unique<memory_block>();
+    block->memory = _device.allocateMemory(vk::MemoryAllocateInfo{size, type});
+    block->size = size;
+    block->mapped = map(block->memory, type);
+
+    _pools[type].push_back(std::move(block));
+    return *_pools[type].back();
+}
+
+void* allocator::map(vk::DeviceMemory memory, std::uint32_t type) const {
+    if (_props.memoryTypes[type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        return _device.mapMemory(memory, 0, VK_WHOLE_SIZE);
+    }
+
+    return nullptr;
+}
+
+bool allocator::coherent(std::uint32_t type) const {
+    const auto flags = _props.memoryTypes[type].propertyFlags;
+    return !(flags & vk::MemoryPropertyFlagBits::eHostVisible) || (flags & vk::MemoryPropertyFlagBits::eHostCoherent);
+}
+
+vk::MappedMemoryRange allocator::mapped_range(const allocation& a, vk::DeviceSize offset, vk::DeviceSize size) const {
+    const auto memory_size = a._block ? a._block->size : a._size;
+
+    size = std::min(size, a._size - offset);
+    const auto begin = (a._offset + offset) / _atom_size * _atom_size;
+    const auto end = std::min(align_up(a._offset + offset + size, _atom_size), memory_size);
+
+    return {a._memory, begin, end - begin};
+}
+
+allocator::statistics allocator::stats() const {
+    std::lock_guard lock{_mutex};
+
+    statistics s{};
+    s.dedicated = _dedicated_count;
+    s.allocations = _dedicated_count;
+    s.reserved = _dedicated_size;
+
+    vk::DeviceSize available{};
+    for (const auto& pool : _pools) {
+        for (const auto& block : pool) {
+            ++s.blocks;
+            s.allocations += block->allocations;
+            s.reserved += block->size;
+
+            for (const auto& [offset, size] : block->free) {
+                available += size;
+                s.largest_free = std::max(s.largest_free, size);
+            }
+        }
+    }
+
+    s.used = s.reserved - available;
+    s.fragmentation = available ? 1.0f - static_cast<float>(s.largest_free) / available : 0.0f;
+
+    return s;
+}
+
+} // namespace vulkan
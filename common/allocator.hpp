@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vulkan {
+
+class allocator;
+struct memory_block;
+
+class allocation {
+    allocator* _owner{nullptr};
+    memory_block* _block{nullptr};
+    vk::DeviceMemory _memory{};
+    vk::DeviceSize _offset{};
+    vk::DeviceSize _size{};
+    std::uint32_t _type{};
+    void* _mapped{nullptr};
+
+    friend class allocator;
+
+  public:
+    allocation() = default;
+    allocation(const allocation&) = delete;
+    allocation& operator=(const allocation&) = delete;
+    allocation(allocation&& other) noexcept;
+    allocation& operator=(allocation&& other) noexcept;
+    ~allocation();
+
+    void release();
+
+    const vk::DeviceMemory& memory() const;
+    vk::DeviceSize offset() const;
+    vk::DeviceSize size() const;
+    std::uint32_t type() const;
+    void* mapped() const;
+    bool dedicated() const;
+
+    // no-ops for host coherent memory, ranges are relative to the allocation
+    void flush(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+    void invalidate(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+};
+
+// block based sub-allocator, one pool of blocks per memory type.
+// every block keeps a sorted free list which is coalesced on free,
+// large requests get their own vkAllocateMemory
+class allocator {
+  public:
+    static constexpr vk::DeviceSize default_block_size{64 * 1024 * 1024};
+
+    struct statistics {
+        std::uint32_t blocks{};
+        std::uint32_t allocations{};
+        std::uint32_t dedicated{};
+        vk::DeviceSize reserved{};
+        vk::DeviceSize used{};
+        vk::DeviceSize largest_free{};
+        // 0 - all free space is contiguous, 1 - free space is scattered
+        float fragmentation{};
+    };
+
+    allocator(const vk::PhysicalDevice& physical, const vk::Device& logical, vk::DeviceSize block_size = default_block_size);
+    allocator(const allocator&) = delete;
+    allocator& operator=(const allocator&) = delete;
+    ~allocator();
+
+    allocation allocate(const vk::MemoryRequirements& req, std::uint32_t type, bool dedicated = false);
+
+    statistics stats() const;
+
+  private:
+    friend class allocation;
+
+    void free(allocation& a);
+    memory_block& make_block(std::uint32_t type, vk::DeviceSize size);
+    void* map(vk::DeviceMemory memory, std::uint32_t type) const;
+
+    bool coherent(std::uint32_t type) const;
+    vk::MappedMemoryRange mapped_range(const allocation& a, vk::DeviceSize offset, vk::DeviceSize size) const;
+
+    vk::Device _device{};
+    vk::PhysicalDeviceMemoryProperties _props{};
+    vk::DeviceSize _granularity{1};
+    vk::DeviceSize _atom_size{1};
+    vk::DeviceSize _block_size{default_block_size};
+
+    std::vector<std::vector<std::unique_ptr<memory_block>>> _pools;
+
+    std::uint32_t _dedicated_count{};
+    vk::DeviceSize _dedicated_size{};
+
+    mutable std::mutex _mutex;
+};
+
+} // namespace vulkan
@@ -1,5 +1,10 @@
 #include "application.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+
 #include <fmt/core.h>
 
 constexpr static const char* device_extensions[] = {
@@ -7,8 +12,49 @@ constexpr static const char* device_extensions[] = {
 };
 
 namespace common {
-application_base::application_base(const vk::ApplicationInfo& app_info, std::uint32_t w, std::uint32_t h)
-    : _name(app_info.pApplicationName), _window(wsi::make_window(w, h, _name)) {
+application_config application_config::parse(int argc, char** argv) {
+    application_config config{};
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg{argv[i]};
+        if (arg == "--present" && i + 1 < argc) {
+            const std::string_view mode{argv[++i]};
+            if (mode == "fifo") {
+                config.swapchain.present_mode = vk::PresentModeKHR::eFifo;
+            } else if (mode == "fifo-relaxed") {
+                config.swapchain.present_mode = vk::PresentModeKHR::eFifoRelaxed;
+            } else if (mode == "mailbox") {
+                config.swapchain.present_mode = vk::PresentModeKHR::eMailbox;
+            } else if (mode == "immediate") {
+                config.swapchain.present_mode = vk::PresentModeKHR::eImmediate;
+            } else {
+                throw std::runtime_error("present mode has to be fifo, fifo-relaxed, mailbox or immediate");
+            }
+        } else if (arg == "--images" && i + 1 < argc) {
+            config.swapchain.image_count = std::max(std::stoi(argv[++i]), 0);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            config.frames_in_flight = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            config.record_threads = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--frame-csv" && i + 1 < argc) {
+            config.frame_csv = argv[++i];
+        }
+    }
+    return config;
+}
+
+namespace {
+
+// the frame loop is scheduled on timeline values, so every application asks for them.
+// they need an application version of at least 1.1
+vulkan::device_features with_timeline(vulkan::device_features features) {
+    features.timeline_semaphore = true;
+    return features;
+}
+
+} // namespace
+
+application_base::application_base(const vk::ApplicationInfo& app_info, std::uint32_t w, std::uint32_t h, const application_config& config)
+    : _name(app_info.pApplicationName), _frames_in_flight(std::max(config.frames_in_flight, 1u)), _window(wsi::make_window(w, h, _name)) {
     // device creation
     auto extensions = wsi::required_extensions();
     auto layers = std::vector<const char*>{};
@@ -26,29 +72,47 @@ application_base::application_base(const vk::ApplicationInfo& app_info, std::uin
         extensions,
         vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute,
         debug,
+        with_timeline(config.features),
     };
+    if (!_device.features().timeline_semaphore) {
+        throw std::runtime_error("the device has neither vulkan 1.2 nor VK_KHR_timeline_semaphore");
+    }
 
     // queue creation
-    _graphic_queue_index = _device.queue_family_index(vk::QueueFlagBits::eGraphics);
+    _graphic_queue_index = _device.graphic_queue_index();
     _graphic_queue = _device.graphic_queue();
-    _present_queue_index = _device.queue_family_index(vk::QueueFlagBits::eGraphics);
+    _present_queue_index = _device.graphic_queue_index();
     _present_queue = _device.graphic_queue();
+    _graphic_timeline = vulkan::timeline_queue{_device, _graphic_queue};
 
     // swapchain creation
     VkSurfaceKHR surf = _window->create_surface(_device.instance());
-    _swapchain = vulkan::swapchain{_device, surf, w, h};
+    _swapchain = vulkan::swapchain{_device, surf, w, h, config.swapchain};
+    _window_extent = vk::Extent2D{w, h};
+
+    // upload ring creation, uniforms are read by the gpu straight from it every frame
+    _ring = vulkan::ring_buffer{
+        _device,
+        ring_frame_size,
+        _frames_in_flight,
+        vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer,
+        vulkan::memory_usage::dynamic,
+    };
 
-    // command pool and buffer creation
-    vk::CommandPoolCreateFlags flags{vk::CommandPoolCreateFlagBits::eResetCommandBuffer};
-    vk::CommandPoolCreateInfo ci{flags, _graphic_queue_index};
-    _command_pool = _device.make_command_pool(ci);
+    // gpu profiler creation
+    _profiler = vulkan::gpu_profiler{_device, _graphic_queue_index, _frames_in_flight};
 
-    vk::CommandBufferAllocateInfo ai{_command_pool, vk::CommandBufferLevel::ePrimary, frames_in_flight};
-    auto buffers = _device.make_command_buffers(ai);
-    for (std::size_t i = 0; i < frames_in_flight; ++i) {
-        _frames[i].command_buffer = std::move(buffers[i]);
+    // a few seconds of frames at typical rates
+    _frame_stats = frame_stats{1024, config.frame_csv};
+
+    // per-frame arenas, the command buffer of a frame comes from its own pool
+    _frames.resize(_frames_in_flight);
+    for (auto& frame : _frames) {
+        frame.context = frame_context{_device, _graphic_queue_index, frame_cpu_scratch, frame_gpu_scratch};
     }
 
+    _recorder = parallel_recorder{_device, _graphic_queue_index, _frames_in_flight, config.record_threads};
+
     // depth image creation
     make_depth_image();
 
@@ -109,14 +173,13 @@ application_base::application_base(const vk::ApplicationInfo& app_info, std::uin
 
     // synchronization creation
     vk::SemaphoreCreateInfo sci{};
-    vk::FenceCreateInfo fci{vk::FenceCreateFlagBits::eSignaled};
-    for (std::size_t i = 0; i < frames_in_flight; ++i) {
+    for (std::size_t i = 0; i < _frames.size(); ++i) {
         _frames[i].image_available_semaphore = _device.make_semaphore(sci);
         _frames[i].render_finished_semaphore = _device.make_semaphore(sci);
-        _frames[i].fence = _device.make_fence(fci);
     }
 
-    _tp = std::chrono::system_clock::now();
+    _tp = std::chrono::steady_clock::now();
+    _title_tp = _tp;
 
     // overlay creation
     vk::DescriptorPoolSize sizes[] = {
@@ -140,41 +203,73 @@ application_base::application_base(const vk::ApplicationInfo& app_info, std::uin
     _overlay = overlay{oci, w, h};
 }
 
-std::uint32_t application_base::acquire() {
-    const auto& fence = _frames[_current_frame].fence;
-    const auto& semaphore = _frames[_current_frame].image_available_semaphore;
-    while (vk::Result::eTimeout == _device.logical().waitForFences(*fence, vk::True, -1)) {
+std::optional<std::uint32_t> application_base::acquire() {
+    auto& frame = _frames[_current_frame];
+    const auto& semaphore = frame.image_available_semaphore;
+    while (!_graphic_timeline.wait(frame.submitted)) {
+    }
+    frame.context.reset();
+    _ring.begin_frame(_current_frame);
+    _profiler.resolve(_current_frame);
+
+    _retired.collect(_graphic_timeline.completed());
+
+    // a zero sized surface cannot have a swapchain, the rebuild waits for the next resize
+    if (_window_extent.width == 0 || _window_extent.height == 0) {
+        return std::nullopt;
+    }
+    if (_swapchain_dirty) {
+        update_swapchain();
     }
-    _device.logical().resetFences(*fence);
 
+    // an out of date acquire does not signal the semaphore, so it can be used again right away.
+    // a surface that stays out of date is left to the next frame after the events are polled
+    constexpr int max_rebuilds{2};
     auto [rv, index] = _swapchain.acquire_next(-1, semaphore);
-    if (rv != vk::Result::eSuccess) {
+    for (int rebuilds = 0; rv == vk::Result::eErrorOutOfDateKHR; ++rebuilds) {
+        if (rebuilds == max_rebuilds) {
+            _swapchain_dirty = true;
+            return std::nullopt;
+        }
+        update_swapchain();
+        std::tie(rv, index) = _swapchain.acquire_next(-1, semaphore);
+    }
+    // the image is usable, the frame is finished on it and the rebuild waits for the next one
+    if (rv == vk::Result::eSuboptimalKHR) {
+        _swapchain_dirty = true;
     }
 
     return index;
 }
 
 void application_base::present(std::uint32_t index) {
-    const auto& [cb, image_available_semaphore, render_finished_semaphore, fence] = _frames[_current_frame];
-    vk::PipelineStageFlags wait_flags{vk::PipelineStageFlagBits::eColorAttachmentOutput};
-    vk::SubmitInfo submit{
-        *image_available_semaphore,
-        wait_flags,
-        *cb,
-        *render_finished_semaphore,
-    };
-    _graphic_queue.submit(submit, fence);
+    auto& [context, image_available_semaphore, render_finished_semaphore, submitted] = _frames[_current_frame];
+    const vulkan::timeline_queue::wait_info wait{{*image_available_semaphore}, vk::PipelineStageFlagBits::eColorAttachmentOutput};
+    const vulkan::timeline_point render_finished{*render_finished_semaphore};
+    submitted = _graphic_timeline.submit(*context.command_buffer(), wait, render_finished).value;
+    _frame_stats.mark(frame_stats::phase::submit);
+
+    present_image(index);
+    _current_frame = (_current_frame + 1) % _frames_in_flight;
+}
 
-    vk::PresentInfoKHR present_info{*render_finished_semaphore, _swapchain.get(), index};
-    auto rv = _present_queue.presentKHR(present_info);
-    if (rv != vk::Result::eSuccess) {
+void application_base::present_image(std::uint32_t index) {
+    const auto& semaphore = _frames[_current_frame].render_finished_semaphore;
+    vk::PresentInfoKHR present_info{*semaphore, _swapchain.get(), index};
+    try {
+        if (_present_queue.presentKHR(present_info) == vk::Result::eSuboptimalKHR) {
+            _swapchain_dirty = true;
+        }
+    } catch (const vk::OutOfDateKHRError&) {
+        // the semaphore wait of a rejected present still executes
+        _swapchain_dirty = true;
     }
-
-    _current_frame = (_current_frame + 1) % frames_in_flight;
 }
 
 void application_base::on_resize(const wsi::event::resize& e) {
-    update_swapchain(e.w, e.h);
+    // several resize events between two frames end up in one rebuild
+    _window_extent = vk::Extent2D{e.w, e.h};
+    _swapchain_dirty = true;
     _overlay.resize(e.w, e.h);
 }
 
@@ -186,13 +281,16 @@ void application_base::on_mouse_button(const wsi::event::mouse::button& e) {
     _overlay.on_mouse_buttons(e.rmb, e.lmb, e.mmb);
 }
 
-void application_base::update_swapchain(std::uint32_t w, std::uint32_t h) {
-    _device.logical().waitIdle();
-
-    _swapchain.resize(_device, w, h);
+void application_base::update_swapchain() {
+    // nothing is waited for, everything submitted so far may still use the old targets
+    const auto in_use = _graphic_timeline.last().value;
+    _retired.retire(in_use, _swapchain.resize(_device, _window_extent.width, _window_extent.height));
+    _retired.retire(in_use, std::move(_framebuffers));
+    _retired.retire(in_use, std::move(_depth));
 
     make_depth_image();
     make_framebuffers();
+    _swapchain_dirty = false;
 }
 
 void application_base::make_framebuffers() {
@@ -225,12 +323,9 @@ void application_base::make_depth_image() {
     };
     _depth.image = _device.make_image(ici);
 
-    const auto req = _depth.image.getMemoryRequirements();
-    const auto index = _device.memory_type_index(req.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-    vk::MemoryAllocateInfo mai{req.size, index};
-    _depth.memory = _device.make_memory(mai);
-    _depth.image.bindMemory(_depth.memory, 0);
+    // render targets are recreated on resize, so keep them out of the shared blocks
+    _depth.memory = _device.allocate_memory(_depth.image.getMemoryRequirements(), vulkan::memory_usage::gpu_only, true);
+    _depth.image.bindMemory(_depth.memory.memory(), _depth.memory.offset());
 
     vk::ImageViewCreateInfo ivci{
         {},
@@ -244,10 +339,16 @@ void application_base::make_depth_image() {
 }
 
 bool application_base::loop_handler() {
-    _counter.count();
-    if (_counter.value()) {
-        _window->set_title(fmt::format("{} - {} fps", _name, _counter.value()));
-        _counter.reset();
+    // the title is only a glance, the overlay has the distribution
+    const auto now = std::chrono::steady_clock::now();
+    if (now - _title_tp >= std::chrono::seconds{1}) {
+        _title_tp = now;
+        const auto s = summarize_frames();
+        if (_profiler.supported()) {
+            _window->set_title(fmt::format("{} - {} - {} fps - p99 {:.2f}ms - gpu {:.2f}ms", _name, vk::to_string(_swapchain.present_mode()), s.fps, s.p99, _profiler.total_ms()));
+        } else {
+            _window->set_title(fmt::format("{} - {} - {} fps - p99 {:.2f}ms", _name, vk::to_string(_swapchain.present_mode()), s.fps, s.p99));
+        }
     }
 
     return true;
@@ -315,30 +416,38 @@ application_base::default_pipeline_info::operator vk::GraphicsPipelineCreateInfo
     };
 }
 
-fps_counter::fps_counter() : _tp(std::chrono::system_clock::now()), _counter(0), _fps(0) {}
-
-void fps_counter::count() {
-    ++_counter;
-    const auto now = std::chrono::system_clock::now();
-    const auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(now - _tp).count();
-
-    if (dur > 1000.0f) {
-        _fps = _counter;
-        _tp = now;
-        _counter = 0;
+void application_base::overlay_gpu_times() const {
+    for (const auto& r : _profiler.results()) {
+        _overlay.text(fmt::format("{}: {:.3f}ms", r.name, r.ms));
     }
 }
 
-void fps_counter::reset() {
-    _fps = 0;
+frame_stats::summary application_base::summarize_frames() {
+    auto& context = _frames[_current_frame].context;
+    auto* scratch = context.allocate_cpu<double>(_frame_stats.size());
+    return _frame_stats.summarize(scratch, scratch ? _frame_stats.size() : 0);
 }
 
-std::uint32_t fps_counter::value() const {
-    return _fps;
+void application_base::overlay_frame_times() {
+    const auto s = summarize_frames();
+    _overlay.text(fmt::format("frame p50 {:.2f}ms p95 {:.2f}ms p99 {:.2f}ms max {:.2f}ms", s.p50, s.p95, s.p99, s.max));
+
+    std::string phases{"cpu"};
+    for (std::size_t p = 0; p < frame_stats::phase_count; ++p) {
+        phases += fmt::format(" {} {:.2f}ms", frame_stats::phase_names[p], s.phase_ms[p]);
+    }
+    _overlay.text(phases);
+
+    // twice the median keeps single spikes visible without flattening the rest
+    // copied into the frame's scratch instead of a new vector every frame
+    auto& context = _frames[_current_frame].context;
+    auto* history = context.allocate_cpu<float>(_frame_stats.size());
+    const auto count = history ? _frame_stats.history(history, _frame_stats.size()) : 0;
+    _overlay.plot("frame ms", history, count, static_cast<float>(std::max(2.0 * s.p50, s.p99)));
 }
 
 float application_base::current_time() const {
-    const auto now = std::chrono::system_clock::now();
+    const auto now = std::chrono::steady_clock::now();
     return std::chrono::duration_cast<std::chrono::milliseconds>(now - _tp).count() / 1000.0f;
 }
 
@@ -1,40 +1,66 @@
 #pragma once
 
+#include "deletion_queue.hpp"
+#include "frame_context.hpp"
+#include "frame_stats.hpp"
+#include "gpu_profiler.hpp"
 #include "overlay.hpp"
+#include "parallel_recorder.hpp"
+#include "ring_buffer.hpp"
+#include "timeline.hpp"
 #include "vulkan.hpp"
 
 #include <chrono>
+#include <optional>
+#include <thread>
 #include <wsi.hpp>
 
 namespace common {
 
-class fps_counter {
-    std::chrono::system_clock::time_point _tp;
-    std::uint32_t _counter;
-    std::uint32_t _fps;
-
-  public:
-    fps_counter();
-    void count();
-    void reset();
-    std::uint32_t value() const;
+// picked at startup, parse() reads --present fifo|fifo-relaxed|mailbox|immediate,
+// --images n, --frames n, --threads n and --frame-csv file and skips everything else
+struct application_config {
+    vulkan::swapchain_config swapchain{};
+    std::uint32_t frames_in_flight{2};
+    // workers of the secondary command buffer recorder
+    std::uint32_t record_threads{1};
+    // every frame time is written here when set
+    std::filesystem::path frame_csv{};
+    vulkan::device_features features{};
+
+    static application_config parse(int argc, char** argv);
 };
 
 class application_base {
-    fps_counter _counter;
     std::string _name;
 
-    std::chrono::system_clock::time_point _tp;
+    std::chrono::steady_clock::time_point _tp;
+    std::chrono::steady_clock::time_point _title_tp;
 
   protected:
-    static constexpr auto frames_in_flight{2};
+    static constexpr vk::DeviceSize ring_frame_size{4 * 1024 * 1024};
+    static constexpr std::size_t frame_cpu_scratch{64 * 1024};
+    static constexpr vk::DeviceSize frame_gpu_scratch{64 * 1024};
 
+    std::uint32_t _frames_in_flight{};
     std::size_t _current_frame{};
 
     std::unique_ptr<wsi::window> _window;
 
     vulkan::device _device;
     vulkan::swapchain _swapchain;
+    // set by resize events and out of date or suboptimal results, acquire() rebuilds then
+    bool _swapchain_dirty{false};
+    vk::Extent2D _window_extent{};
+
+    // per-frame staging and uniform memory, recycled once the frame's submit has completed
+    vulkan::ring_buffer _ring;
+
+    // one query slot per frame in flight, resolved in acquire() after the frame's submit
+    vulkan::gpu_profiler _profiler;
+
+    // cpu side of every frame, the loop marks the phases and present() the submit
+    frame_stats _frame_stats;
 
     vk::raii::DescriptorPool _overlay_desc_pool{nullptr};
     overlay _overlay;
@@ -45,28 +71,41 @@ class application_base {
     vk::Queue _graphic_queue{nullptr};
     vk::Queue _present_queue{nullptr};
 
+    // every frame submit signals the next value, acquire() waits for the value of its slot
+    vulkan::timeline_queue _graphic_timeline;
+    // render targets replaced by a rebuild, freed once the frames using them are done
+    vulkan::deletion_queue _retired;
+
     vk::raii::RenderPass _render_pass{nullptr};
 
     std::vector<vk::raii::Framebuffer> _framebuffers{};
 
-    vk::raii::CommandPool _command_pool{nullptr};
-
     struct frame_data {
-        vk::raii::CommandBuffer command_buffer{nullptr};
+        // reset as a whole in acquire() once submitted is reached
+        frame_context context;
+        // binary, the swapchain does not take timeline semaphores
         vk::raii::Semaphore image_available_semaphore{nullptr};
         vk::raii::Semaphore render_finished_semaphore{nullptr};
-        vk::raii::Fence fence{nullptr};
+        // the graphic timeline value of the last submit of this frame
+        std::uint64_t submitted{};
     };
-    std::array<frame_data, frames_in_flight> _frames;
+    // one per frame in flight
+    std::vector<frame_data> _frames;
+
+    // secondary command buffers for draws split across threads, indexed by _current_frame
+    parallel_recorder _recorder;
 
     struct depth {
         vk::raii::Image image{nullptr};
         vk::raii::ImageView view{nullptr};
-        vk::raii::DeviceMemory memory{nullptr};
+        vulkan::allocation memory;
     } _depth;
 
-    std::uint32_t acquire();
+    // nullopt when there is nothing to render to, e.g. while the window is minimized
+    std::optional<std::uint32_t> acquire();
     void present(std::uint32_t i);
+    // presents the current frame's image, an out of date swapchain is rebuilt on the next acquire()
+    void present_image(std::uint32_t i);
 
     bool loop_handler();
 
@@ -92,13 +131,20 @@ class application_base {
 
     float current_time() const;
 
+    // per-pass gpu times of the last resolved frame
+    void overlay_gpu_times() const;
+    // rolling frame time percentiles, the phase split and a graph of the kept frames
+    void overlay_frame_times();
+    // the kept frame times are sorted in the current frame's cpu scratch
+    frame_stats::summary summarize_frames();
+
   private:
-    void update_swapchain(std::uint32_t w, std::uint32_t h);
+    void update_swapchain();
     void make_framebuffers();
     void make_depth_image();
 
   public:
-    application_base(const vk::ApplicationInfo& app_info, std::uint32_t w, std::uint32_t h);
+    application_base(const vk::ApplicationInfo& app_info, std::uint32_t w, std::uint32_t h, const application_config& config = {});
 };
 
 template <typename T>
@@ -114,7 +160,7 @@ class application : public application_base {
 
     void on_mouse_button(const wsi::event::mouse::button& e) {}
 
-    std::uint32_t acquire_impl() {
+    std::optional<std::uint32_t> acquire_impl() {
         return impl().acquire();
     }
 
@@ -135,8 +181,8 @@ class application : public application_base {
     overloaded(Ts...) -> overloaded<Ts...>;
 
   public:
-    application(const vk::ApplicationInfo& app_info, std::uint32_t w, std::uint32_t h)
-        : application_base(app_info, w, h) {
+    application(const vk::ApplicationInfo& app_info, std::uint32_t w, std::uint32_t h, const application_config& config = {})
+        : application_base(app_info, w, h, config) {
     }
 
     bool _running{true};
@@ -159,12 +205,22 @@ class application : public application_base {
         };
 
         while (_running) {
+            _frame_stats.begin_frame();
             application_base::loop_handler();
             std::visit(visitor, _window->poll_event());
 
             const auto i = acquire_impl();
-            record_impl(i);
-            present_impl(i);
+            if (!i) {
+                // back to the event loop, without spinning on it
+                _frame_stats.skip_frame();
+                std::this_thread::sleep_for(std::chrono::milliseconds{10});
+                continue;
+            }
+            _frame_stats.mark(frame_stats::phase::acquire);
+            record_impl(*i);
+            _frame_stats.mark(frame_stats::phase::record);
+            present_impl(*i);
+            _frame_stats.end_frame();
         }
 
         _device.logical().waitIdle();
@@ -0,0 +1,21 @@
+#include "deletion_queue.hpp"
+
+#include <algorithm>
+
+namespace vulkan {
+
+void deletion_queue::collect(std::uint64_t completed) {
+    // values only grow, so the finished entries are a prefix
+    const auto end = std::find_if(_retired.begin(), _retired.end(), [completed](const auto& r) { return r.first > completed; });
+    _retired.erase(_retired.begin(), end);
+}
+
+void deletion_queue::clear() {
+    _retired.clear();
+}
+
+std::size_t deletion_queue::size() const {
+    return _retired.size();
+}
+
+} // namespace vulkan
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vulkan {
+
+// keeps objects the gpu may still use alive until a timeline value is reached.
+// anything movable can be retired, raii handles are destroyed by collect()
+class deletion_queue {
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<void>>> _retired;
+
+  public:
+    template <typename T>
+    void retire(std::uint64_t value, T&& object) {
+        _retired.emplace_back(value, std::make_shared<std::decay_t<T>>(std::forward<T>(object)));
+    }
+
+    // destroys everything retired at or before completed, in retire order
+    void collect(std::uint64_t completed);
+    void clear();
+
+    std::size_t size() const;
+};
+
+} // namespace vulkan
@@ -0,0 +1,83 @@
+#include "frame_context.hpp"
+
+#include <algorithm>
+
+namespace common {
+
+namespace {
+
+// enough for a few passes worth of per-frame sets, the pool is never freed from
+constexpr std::uint32_t max_sets{16};
+constexpr vk::DescriptorPoolSize pool_sizes[] = {
+    {vk::DescriptorType::eUniformBuffer, 16},
+    {vk::DescriptorType::eStorageBuffer, 16},
+    {vk::DescriptorType::eStorageImage, 16},
+    {vk::DescriptorType::eCombinedImageSampler, 16},
+};
+
+} // namespace
+
+frame_context::frame_context(const vulkan::device& dev, std::uint32_t queue_family, std::size_t cpu_scratch, vk::DeviceSize gpu_scratch)
+    : _logical(dev.logical()), _cpu_scratch(std::make_unique<std::byte[]>(cpu_scratch)), _cpu_size(cpu_scratch) {
+    // no per-buffer reset flag, the pool is the unit that gets recycled
+    _command_pool = dev.make_command_pool({vk::CommandPoolCreateFlagBits::eTransient, queue_family});
+    _command_buffer = std::move(dev.make_command_buffers({_command_pool, vk::CommandBufferLevel::ePrimary, 1}).front());
+
+    _descriptor_pool = dev.make_descriptor_pool({{}, max_sets, pool_sizes});
+
+    const auto limits = dev.physical().getProperties().limits;
+    _gpu_alignment = std::max({limits.minStorageBufferOffsetAlignment, limits.minUniformBufferOffsetAlignment, vk::DeviceSize{16}});
+    _gpu_scratch = {
+        dev,
+        std::max(gpu_scratch, _gpu_alignment),
+        vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+    };
+}
+
+void frame_context::reset() {
+    _command_pool.reset();
+    _descriptor_pool.reset();
+    _cpu_head = 0;
+    _gpu_head = 0;
+}
+
+const vk::raii::CommandBuffer& frame_context::command_buffer() const {
+    return _command_buffer;
+}
+
+vk::DescriptorSet frame_context::allocate_descriptor_set(const vk::DescriptorSetLayout& layout) {
+    vk::DescriptorSetAllocateInfo dsai{*_descriptor_pool, layout};
+    return _logical.allocateDescriptorSets(dsai).front();
+}
+
+void* frame_context::allocate_cpu(std::size_t size, std::size_t alignment) {
+    const auto begin = (_cpu_head + alignment - 1) / alignment * alignment;
+    if (begin + size > _cpu_size) {
+        return nullptr;
+    }
+
+    _cpu_head = begin + size;
+    return _cpu_scratch.get() + begin;
+}
+
+std::optional<frame_context::gpu_range> frame_context::allocate_gpu(vk::DeviceSize size, vk::DeviceSize alignment) {
+    alignment = std::max(alignment, _gpu_alignment);
+
+    const auto begin = (_gpu_head + alignment - 1) / alignment * alignment;
+    if (begin + size > _gpu_scratch.size()) {
+        return std::nullopt;
+    }
+
+    _gpu_head = begin + size;
+    return gpu_range{_gpu_scratch.buf(), begin, size};
+}
+
+std::size_t frame_context::cpu_used() const {
+    return _cpu_head;
+}
+
+vk::DeviceSize frame_context::gpu_used() const {
+    return _gpu_head;
+}
+
+} // namespace common
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "vulkan.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+namespace common {
+
+// everything a frame allocates that dies with the frame: the primary command buffer,
+// descriptor sets, cpu scratch and device local gpu scratch. allocations are pointer
+// bumps and reset() drops all of them at once, once the frame's last submit has completed
+class frame_context {
+    vk::Device _logical{nullptr};
+
+    vk::raii::CommandPool _command_pool{nullptr};
+    vk::raii::CommandBuffer _command_buffer{nullptr};
+    vk::raii::DescriptorPool _descriptor_pool{nullptr};
+
+    std::unique_ptr<std::byte[]> _cpu_scratch;
+    std::size_t _cpu_size{};
+    std::size_t _cpu_head{};
+
+    vulkan::device_buffer _gpu_scratch;
+    vk::DeviceSize _gpu_alignment{};
+    vk::DeviceSize _gpu_head{};
+
+  public:
+    struct gpu_range {
+        vk::Buffer buffer{};
+        vk::DeviceSize offset{};
+        vk::DeviceSize size{};
+    };
+
+    frame_context() = default;
+    frame_context(const vulkan::device& dev, std::uint32_t queue_family, std::size_t cpu_scratch, vk::DeviceSize gpu_scratch);
+
+    void reset();
+
+    // begin it once per frame, it is reset with the pool
+    const vk::raii::CommandBuffer& command_buffer() const;
+
+    // sets are not freed one by one, they stay valid until reset()
+    vk::DescriptorSet allocate_descriptor_set(const vk::DescriptorSetLayout& layout);
+
+    // nullptr once the frame ran out of scratch, nothing is constructed or destroyed
+    void* allocate_cpu(std::size_t size, std::size_t alignment = alignof(std::max_align_t));
+    template <typename T>
+    T* allocate_cpu(std::size_t count) {
+        return static_cast<T*>(allocate_cpu(sizeof(T) * count, alignof(T)));
+    }
+
+    // uniform, storage and transfer usable, aligned for uniform and storage offsets
+    std::optional<gpu_range> allocate_gpu(vk::DeviceSize size, vk::DeviceSize alignment = 0);
+
+    std::size_t cpu_used() const;
+    vk::DeviceSize gpu_used() const;
+};
+
+} // namespace common
@@ -0,0 +1,117 @@
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <fmt/core.h>
+
+namespace common {
+
+namespace {
+
+double to_ms(frame_stats::clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // namespace
+
+frame_stats::frame_stats(std::size_t capacity, const std::filesystem::path& csv)
+    : _ring(std::max<std::size_t>(capacity, 1)) {
+    if (!csv.empty()) {
+        _csv.open(csv, std::ios::trunc);
+        _csv << "frame,frame_ms,acquire_ms,record_ms,submit_ms,present_ms\n";
+    }
+}
+
+void frame_stats::begin_frame() {
+    const auto now = clock::now();
+    if (_started) {
+        _current.frame_ms = to_ms(now - _begin);
+        _ring[_next] = _current;
+        _next = (_next + 1) % _ring.size();
+        _count = std::min(_count + 1, _ring.size());
+
+        if (_csv.is_open()) {
+            const auto& p = _current.phase_ms;
+            _csv << fmt::format("{},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f}\n", _frame, _current.frame_ms, p[0], p[1], p[2], p[3]);
+        }
+        ++_frame;
+    }
+
+    _started = true;
+    _begin = now;
+    _last_mark = now;
+    _current = {};
+}
+
+void frame_stats::mark(phase p) {
+    const auto now = clock::now();
+    _current.phase_ms[static_cast<std::size_t>(p)] += to_ms(now - _last_mark);
+    _last_mark = now;
+}
+
+void frame_stats::end_frame() {
+    mark(phase::present);
+}
+
+void frame_stats::skip_frame() {
+    _started = false;
+}
+
+std::size_t frame_stats::history(float* values, std::size_t capacity) const {
+    const auto count = std::min(capacity, _count);
+    const auto first = (_next + _ring.size() - count) % _ring.size();
+    for (std::size_t i = 0; i < count; ++i) {
+        values[i] = static_cast<float>(_ring[(first + i) % _ring.size()].frame_ms);
+    }
+    return count;
+}
+
+std::size_t frame_stats::size() const {
+    return _count;
+}
+
+frame_stats::summary frame_stats::summarize(double* scratch, std::size_t capacity) const {
+    summary s{};
+    if (!_count) {
+        return s;
+    }
+
+    for (std::size_t i = 0; i < _count; ++i) {
+        for (std::size_t p = 0; p < phase_count; ++p) {
+            s.phase_ms[p] += _ring[i].phase_ms[p] / _count;
+        }
+    }
+
+    const auto count = std::min(capacity, _count);
+    if (scratch && count) {
+        const auto first = (_next + _ring.size() - count) % _ring.size();
+        for (std::size_t i = 0; i < count; ++i) {
+            scratch[i] = _ring[(first + i) % _ring.size()].frame_ms;
+        }
+        std::sort(scratch, scratch + count);
+
+        // nearest rank, the smallest sample with at least q of all samples at or below it
+        const auto rank = [scratch, count](double q) {
+            const auto r = static_cast<std::size_t>(std::ceil(q * count));
+            return scratch[std::clamp<std::size_t>(r, 1, count) - 1];
+        };
+        s.p50 = rank(0.50);
+        s.p95 = rank(0.95);
+        s.p99 = rank(0.99);
+        s.max = scratch[count - 1];
+    }
+
+    // rate over the newest frames that add up to about a second
+    double span{};
+    std::size_t frames{};
+    const auto newest = (_next + _ring.size() - 1) % _ring.size();
+    for (; frames < _count && span < 1000.0; ++frames) {
+        span += _ring[(newest + _ring.size() - frames) % _ring.size()].frame_ms;
+    }
+    s.fps = span > 0.0 ? static_cast<std::uint32_t>(frames * 1000.0 / span + 0.5) : 0;
+
+    return s;
+}
+
+} // namespace common
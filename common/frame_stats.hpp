@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+namespace common {
+
+// cpu time of every frame on the steady clock, split into the phases of the
+// main loop. the last frames are kept in a ring for rolling percentiles and
+// the graph in the overlay, a csv file gets every frame when one is given
+class frame_stats {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    enum class phase : std::size_t {
+        acquire,
+        record,
+        submit,
+        present,
+    };
+    static constexpr std::size_t phase_count = 4;
+    static constexpr std::string_view phase_names[phase_count] = {"acquire", "record", "submit", "present"};
+
+    struct sample {
+        // begin to begin of consecutive frames, what pacing is judged by
+        double frame_ms{};
+        std::array<double, phase_count> phase_ms{};
+    };
+
+    struct summary {
+        double p50{};
+        double p95{};
+        double p99{};
+        double max{};
+        // average per phase over the ring
+        std::array<double, phase_count> phase_ms{};
+        std::uint32_t fps{};
+    };
+
+  private:
+    std::vector<sample> _ring;
+    std::size_t _next{};
+    std::size_t _count{};
+    std::uint64_t _frame{};
+
+    clock::time_point _begin{};
+    clock::time_point _last_mark{};
+    sample _current{};
+    bool _started{false};
+
+    std::ofstream _csv;
+
+  public:
+    frame_stats() = default;
+    explicit frame_stats(std::size_t capacity, const std::filesystem::path& csv = {});
+
+    // the previous frame is finished here, so its frame time is known
+    void begin_frame();
+    // time since the previous mark is charged to p
+    void mark(phase p);
+    // whatever is left after the last mark belongs to present
+    void end_frame();
+    // the current frame had nothing to present and is not counted
+    void skip_frame();
+
+    // copies the newest kept frame times that fit into values, oldest first, returns how many
+    std::size_t history(float* values, std::size_t capacity) const;
+    std::size_t size() const;
+    // the percentiles are taken over the newest frame times that fit into scratch, which
+    // is sorted in place so no allocation happens per call
+    summary summarize(double* scratch, std::size_t capacity) const;
+};
+
+} // namespace common
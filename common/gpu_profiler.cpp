@@ -0,0 +1,111 @@
+#include "gpu_profiler.hpp"
+
+namespace vulkan {
+
+gpu_profiler::scope::scope(gpu_profiler* profiler, const vk::CommandBuffer& cb, std::uint32_t marker)
+    : _profiler(profiler), _cb(cb), _marker(marker) {}
+
+gpu_profiler::scope::~scope() {
+    _profiler->end(_cb, _marker);
+}
+
+gpu_profiler::gpu_profiler(const device& dev, std::uint32_t queue_family, std::uint32_t slots, std::uint32_t max_markers)
+    : _max_markers(max_markers) {
+    const auto families = dev.physical().getQueueFamilyProperties();
+    const auto valid_bits = families[queue_family].timestampValidBits;
+    const auto period = dev.physical().getProperties().limits.timestampPeriod;
+    if (!valid_bits || period <= 0.0f) {
+        return;
+    }
+
+    _period = period;
+    _mask = valid_bits >= 64 ? ~std::uint64_t{} : (std::uint64_t{1} << valid_bits) - 1;
+
+    _slots.resize(slots);
+    for (auto& s : _slots) {
+        s.pool = dev.make_query_pool({{}, vk::QueryType::eTimestamp, 2 * max_markers});
+    }
+}
+
+bool gpu_profiler::supported() const {
+    return !_slots.empty();
+}
+
+void gpu_profiler::reset(const vk::CommandBuffer& cb, std::uint32_t slot) {
+    if (!supported()) {
+        return;
+    }
+
+    _current = slot % _slots.size();
+    auto& s = _slots[_current];
+    s.names.clear();
+    cb.resetQueryPool(*s.pool, 0, 2 * _max_markers);
+}
+
+std::uint32_t gpu_profiler::begin(const vk::CommandBuffer& cb, std::string_view name) {
+    if (!supported()) {
+        return no_marker;
+    }
+
+    auto& s = _slots[_current];
+    if (s.names.size() == _max_markers) {
+        return no_marker;
+    }
+
+    const auto marker = static_cast<std::uint32_t>(s.names.size());
+    s.names.emplace_back(name);
+    cb.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *s.pool, 2 * marker);
+
+    return marker;
+}
+
+void gpu_profiler::end(const vk::CommandBuffer& cb, std::uint32_t marker) {
+    if (marker == no_marker) {
+        return;
+    }
+
+    cb.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *_slots[_current].pool, 2 * marker + 1);
+}
+
+gpu_profiler::scope gpu_profiler::scoped(const vk::CommandBuffer& cb, std::string_view name) {
+    return scope{this, cb, begin(cb, name)};
+}
+
+bool gpu_profiler::resolve(std::uint32_t slot) {
+    if (!supported()) {
+        return false;
+    }
+
+    const auto& s = _slots[slot % _slots.size()];
+    if (s.names.empty()) {
+        return false;
+    }
+
+    const auto count = static_cast<std::uint32_t>(2 * s.names.size());
+    const auto [rv, ticks] = s.pool.getResults<std::uint64_t>(0, count, count * sizeof(std::uint64_t), sizeof(std::uint64_t), vk::QueryResultFlagBits::e64);
+    if (rv != vk::Result::eSuccess) {
+        return false;
+    }
+
+    _results.resize(s.names.size());
+    for (std::size_t i = 0; i < s.names.size(); ++i) {
+        const auto elapsed = ((ticks[2 * i + 1] & _mask) - (ticks[2 * i] & _mask)) & _mask;
+        _results[i] = {s.names[i], elapsed * _period / 1e6};
+    }
+
+    return true;
+}
+
+const std::vector<gpu_profiler::result>& gpu_profiler::results() const {
+    return _results;
+}
+
+double gpu_profiler::total_ms() const {
+    double total{};
+    for (const auto& r : _results) {
+        total += r.ms;
+    }
+    return total;
+}
+
+} // namespace vulkan
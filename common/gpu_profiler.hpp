@@ -0,0 +1,73 @@
+#pragma once
+
+#include "vulkan.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vulkan {
+
+// timestamp queries with one pool per frame slot. markers recorded into a slot
+// are read back by resolve() once the fence of that slot has been waited, which
+// never stalls, results of a slot that is not finished yet are simply skipped
+class gpu_profiler {
+  public:
+    struct result {
+        std::string name;
+        double ms{};
+    };
+
+    class scope {
+        gpu_profiler* _profiler;
+        vk::CommandBuffer _cb;
+        std::uint32_t _marker;
+
+      public:
+        scope(gpu_profiler* profiler, const vk::CommandBuffer& cb, std::uint32_t marker);
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+        ~scope();
+    };
+
+  private:
+    struct frame_slot {
+        vk::raii::QueryPool pool{nullptr};
+        std::vector<std::string> names{};
+    };
+
+    std::vector<frame_slot> _slots;
+    std::uint32_t _current{};
+    std::uint32_t _max_markers{};
+    // nanoseconds per tick
+    double _period{};
+    std::uint64_t _mask{};
+
+    std::vector<result> _results;
+
+  public:
+    static constexpr auto no_marker = ~std::uint32_t{};
+
+    gpu_profiler() = default;
+    // queue_family is the family the profiled command buffers are submitted to,
+    // without timestamp support on it every call is a no-op
+    gpu_profiler(const device& dev, std::uint32_t queue_family, std::uint32_t slots, std::uint32_t max_markers = 16);
+
+    bool supported() const;
+
+    // has to be recorded outside of a render pass before the first marker of the slot
+    void reset(const vk::CommandBuffer& cb, std::uint32_t slot);
+
+    std::uint32_t begin(const vk::CommandBuffer& cb, std::string_view name);
+    void end(const vk::CommandBuffer& cb, std::uint32_t marker);
+    [[nodiscard]] scope scoped(const vk::CommandBuffer& cb, std::string_view name);
+
+    // false when the slot has no markers or the gpu is not done with them yet
+    bool resolve(std::uint32_t slot);
+
+    // markers of the last resolved slot in recording order
+    const std::vector<result>& results() const;
+    double total_ms() const;
+};
+
+} // namespace vulkan
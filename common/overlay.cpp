@@ -72,4 +72,8 @@ void overlay::text(std::string_view text) const {
     ImGui::Text("%s", text.data());
 }
 
+void overlay::plot(std::string_view label, const float* values, std::size_t count, float max) const {
+    ImGui::PlotLines(label.data(), values, static_cast<int>(count), 0, nullptr, 0.0f, max, ImVec2{0.0f, 60.0f});
+}
+
 } // namespace common
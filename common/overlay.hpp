@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string_view>
 #include <vulkan/vulkan.h>
 
@@ -31,6 +32,8 @@ class overlay {
 
     bool button(std::string_view name) const;
     void text(std::string_view text) const;
+    // a line graph of count values scaled to [0, max]
+    void plot(std::string_view label, const float* values, std::size_t count, float max) const;
 };
 
 } // namespace common
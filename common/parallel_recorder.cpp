@@ -0,0 +1,76 @@
+#include "parallel_recorder.hpp"
+
+#include <algorithm>
+
+namespace common {
+
+parallel_recorder::parallel_recorder(const vulkan::device& dev, std::uint32_t queue_family, std::uint32_t frames, std::uint32_t workers)
+    : _workers(std::max(workers, 1u)) {
+    // a single worker records on the calling thread, the hand-off would only add latency
+    if (_workers > 1) {
+        _pool = std::make_unique<thread_pool>(_workers);
+    }
+
+    _slots.resize(std::size_t{frames} * (_workers + 1));
+    for (auto& s : _slots) {
+        s.pool = dev.make_command_pool({vk::CommandPoolCreateFlagBits::eTransient, queue_family});
+        auto buffers = dev.make_command_buffers({s.pool, vk::CommandBufferLevel::eSecondary, 1});
+        s.buffer = std::move(buffers.front());
+    }
+}
+
+parallel_recorder::slot& parallel_recorder::at(std::size_t frame, std::size_t worker) {
+    return _slots[frame * (_workers + 1) + worker];
+}
+
+std::uint32_t parallel_recorder::workers() const {
+    return _workers;
+}
+
+void parallel_recorder::record(std::size_t frame, const vk::CommandBuffer& primary, const vk::CommandBufferInheritanceInfo& inheritance, std::size_t count, const chunk_fn& chunk, const tail_fn& tail) {
+    const vk::CommandBufferBeginInfo begin_info{vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inheritance};
+    const auto record_one = [&](slot& s, auto&& fn) {
+        // the frame's last submit has completed before record, nothing from this pool is pending
+        s.pool.reset();
+        s.buffer.begin(begin_info);
+        fn(*s.buffer);
+        s.buffer.end();
+    };
+
+    const auto chunks = std::min<std::size_t>(_workers, count);
+    const auto per_chunk = chunks ? (count + chunks - 1) / chunks : 0;
+    for (std::size_t w = 0; w < chunks; ++w) {
+        const auto begin = w * per_chunk;
+        const auto end = std::min(begin + per_chunk, count);
+        auto& s = at(frame, w);
+        const auto task = [&record_one, &chunk, &s, begin, end] {
+            record_one(s, [&](const vk::CommandBuffer& cb) { chunk(cb, begin, end); });
+        };
+
+        if (_pool) {
+            _pool->submit(task);
+        } else {
+            task();
+        }
+    }
+
+    if (tail) {
+        record_one(at(frame, _workers), tail);
+    }
+    if (_pool) {
+        _pool->wait();
+    }
+
+    std::vector<vk::CommandBuffer> buffers{};
+    for (std::size_t w = 0; w < chunks; ++w) {
+        buffers.push_back(*at(frame, w).buffer);
+    }
+    if (tail) {
+        buffers.push_back(*at(frame, _workers).buffer);
+    }
+    if (!buffers.empty()) {
+        primary.executeCommands(buffers);
+    }
+}
+
+} // namespace common
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "thread_pool.hpp"
+#include "vulkan.hpp"
+
+#include <functional>
+#include <memory>
+
+namespace common {
+
+// records a render pass worth of draws as secondary command buffers on a thread pool.
+// every worker owns one command pool per frame in flight, so no pool is shared between
+// threads and a whole frame is recycled with one reset once its last submit has completed
+class parallel_recorder {
+    struct slot {
+        vk::raii::CommandPool pool{nullptr};
+        vk::raii::CommandBuffer buffer{nullptr};
+    };
+
+    std::unique_ptr<thread_pool> _pool;
+    std::uint32_t _workers{};
+    // workers + 1 per frame, the last one is recorded on the calling thread
+    std::vector<slot> _slots;
+
+    slot& at(std::size_t frame, std::size_t worker);
+
+  public:
+    // draws [begin, end) of the split range into a secondary buffer inside the render pass
+    using chunk_fn = std::function<void(const vk::CommandBuffer& cb, std::size_t begin, std::size_t end)>;
+    using tail_fn = std::function<void(const vk::CommandBuffer& cb)>;
+
+    parallel_recorder() = default;
+    parallel_recorder(const vulkan::device& dev, std::uint32_t queue_family, std::uint32_t frames, std::uint32_t workers);
+
+    std::uint32_t workers() const;
+
+    // splits [0, count) into one contiguous chunk per worker, records them in parallel and
+    // tail on this thread, then executes everything in order in primary. primary has to be
+    // inside a render pass begun with secondary command buffer contents
+    void record(std::size_t frame, const vk::CommandBuffer& primary, const vk::CommandBufferInheritanceInfo& inheritance, std::size_t count, const chunk_fn& chunk, const tail_fn& tail = {});
+};
+
+} // namespace common
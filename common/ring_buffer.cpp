@@ -0,0 +1,78 @@
+#include "ring_buffer.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace vulkan {
+
+std::uint32_t ring_buffer::range::dynamic_offset() const {
+    return static_cast<std::uint32_t>(offset);
+}
+
+ring_buffer::ring_buffer(const device& dev, vk::DeviceSize frame_size, std::uint32_t frames, vk::BufferUsageFlags usage, memory_usage placement)
+    : _frames(frames) {
+    const auto limits = dev.physical().getProperties().limits;
+
+    // satisfies uniform/storage dynamic offsets and buffer to image copies of 4 byte texels
+    _alignment = std::max({
+        limits.minUniformBufferOffsetAlignment,
+        limits.minStorageBufferOffsetAlignment,
+        limits.optimalBufferCopyOffsetAlignment,
+        vk::DeviceSize{16},
+    });
+    _frame_size = (frame_size + _alignment - 1) / _alignment * _alignment;
+
+    _buffer = {dev, _frame_size * frames, usage, placement};
+}
+
+void ring_buffer::begin_frame(std::uint32_t frame) {
+    _frame = frame % _frames;
+    _head = 0;
+}
+
+std::optional<ring_buffer::range> ring_buffer::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+    alignment = std::max(alignment, _alignment);
+
+    const auto begin = (_head + alignment - 1) / alignment * alignment;
+    if (begin + size > _frame_size) {
+        return std::nullopt;
+    }
+
+    _head = begin + size;
+
+    const auto offset = _frame * _frame_size + begin;
+    return range{
+        _buffer.buf(),
+        offset,
+        size,
+        static_cast<std::uint8_t*>(_buffer.mapped()) + offset,
+    };
+}
+
+std::optional<ring_buffer::range> ring_buffer::push(const void* data, vk::DeviceSize size, vk::DeviceSize alignment) {
+    auto r = allocate(size, alignment);
+    if (r) {
+        std::memcpy(r->data, data, size);
+        flush(*r);
+    }
+
+    return r;
+}
+
+void ring_buffer::flush(const range& r) const {
+    _buffer.flush(r.offset, r.size);
+}
+
+const vk::Buffer& ring_buffer::buf() const {
+    return _buffer.buf();
+}
+
+vk::DeviceSize ring_buffer::frame_size() const {
+    return _frame_size;
+}
+
+vk::DeviceSize ring_buffer::used() const {
+    return _head;
+}
+
+} // namespace vulkan
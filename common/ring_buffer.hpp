@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vulkan.hpp"
+
+#include <optional>
+
+namespace vulkan {
+
+// persistently mapped buffer split into one linear partition per frame in flight.
+// a partition is handed out again only after begin_frame() is called for it,
+// which has to happen once the fence of that frame has been waited
+class ring_buffer {
+    host_buffer _buffer;
+    vk::DeviceSize _frame_size{};
+    vk::DeviceSize _alignment{};
+    std::uint32_t _frames{};
+    std::uint32_t _frame{};
+    vk::DeviceSize _head{};
+
+  public:
+    struct range {
+        vk::Buffer buffer{};
+        vk::DeviceSize offset{};
+        vk::DeviceSize size{};
+        void* data{nullptr};
+
+        std::uint32_t dynamic_offset() const;
+    };
+
+    ring_buffer() = default;
+    ring_buffer(const device& dev, vk::DeviceSize frame_size, std::uint32_t frames, vk::BufferUsageFlags usage, memory_usage placement = memory_usage::upload);
+
+    void begin_frame(std::uint32_t frame);
+
+    std::optional<range> allocate(vk::DeviceSize size, vk::DeviceSize alignment = 0);
+    std::optional<range> push(const void* data, vk::DeviceSize size, vk::DeviceSize alignment = 0);
+    // ranges written directly through data have to be flushed before submission
+    void flush(const range& r) const;
+
+    const vk::Buffer& buf() const;
+    vk::DeviceSize frame_size() const;
+    vk::DeviceSize used() const;
+};
+
+} // namespace vulkan
@@ -0,0 +1,56 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+namespace common {
+
+thread_pool::thread_pool(std::size_t threads, std::size_t queue_size)
+    : _tasks(queue_size) {
+    threads = std::max<std::size_t>(threads, 1);
+    for (std::size_t i = 0; i < threads; ++i) {
+        _threads.emplace_back([this] { run(); });
+    }
+}
+
+thread_pool::~thread_pool() {
+    _tasks.close();
+    for (auto& t : _threads) {
+        t.join();
+    }
+}
+
+void thread_pool::run() {
+    while (auto task = _tasks.pop()) {
+        (*task)();
+
+        std::lock_guard lock{_mutex};
+        if (--_pending == 0) {
+            _idle.notify_all();
+        }
+    }
+}
+
+void thread_pool::submit(std::function<void()> task) {
+    {
+        std::lock_guard lock{_mutex};
+        ++_pending;
+    }
+
+    if (!_tasks.push(std::move(task))) {
+        std::lock_guard lock{_mutex};
+        if (--_pending == 0) {
+            _idle.notify_all();
+        }
+    }
+}
+
+void thread_pool::wait() {
+    std::unique_lock lock{_mutex};
+    _idle.wait(lock, [this] { return _pending == 0; });
+}
+
+std::size_t thread_pool::size() const {
+    return _threads.size();
+}
+
+} // namespace common
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace common {
+
+// fixed capacity fifo, push blocks while full and pop blocks while empty.
+// after close() pushes are rejected and pop drains what is left before returning nullopt
+template <typename T>
+class bounded_queue {
+    std::deque<T> _items;
+    std::size_t _capacity;
+    bool _closed{false};
+
+    std::mutex _mutex;
+    std::condition_variable _not_full;
+    std::condition_variable _not_empty;
+
+  public:
+    explicit bounded_queue(std::size_t capacity) : _capacity(capacity ? capacity : 1) {}
+
+    bool push(T item) {
+        std::unique_lock lock{_mutex};
+        _not_full.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+        if (_closed) {
+            return false;
+        }
+
+        _items.push_back(std::move(item));
+        lock.unlock();
+        _not_empty.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop() {
+        std::unique_lock lock{_mutex};
+        _not_empty.wait(lock, [this] { return _closed || !_items.empty(); });
+        if (_items.empty()) {
+            return std::nullopt;
+        }
+
+        auto item = std::move(_items.front());
+        _items.pop_front();
+        lock.unlock();
+        _not_full.notify_one();
+        return item;
+    }
+
+    void close() {
+        {
+            std::lock_guard lock{_mutex};
+            _closed = true;
+        }
+        _not_full.notify_all();
+        _not_empty.notify_all();
+    }
+};
+
+// workers pulling tasks from a bounded queue, submit blocks while the queue is full.
+// tasks must not throw
+class thread_pool {
+    bounded_queue<std::function<void()>> _tasks;
+    std::vector<std::thread> _threads;
+
+    std::mutex _mutex;
+    std::condition_variable _idle;
+    std::size_t _pending{};
+
+    void run();
+
+  public:
+    explicit thread_pool(std::size_t threads = std::thread::hardware_concurrency(), std::size_t queue_size = 64);
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+    ~thread_pool();
+
+    void submit(std::function<void()> task);
+    // blocks until every submitted task has finished
+    void wait();
+
+    std::size_t size() const;
+};
+
+} // namespace common
@@ -0,0 +1,76 @@
+#include "timeline.hpp"
+
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace vulkan {
+
+timeline_queue::timeline_queue(const device& dev, const vk::Queue& queue)
+    : _queue(queue) {
+    vk::StructureChain<vk::SemaphoreCreateInfo, vk::SemaphoreTypeCreateInfo> sci{
+        {},
+        {vk::SemaphoreType::eTimeline, 0},
+    };
+    _semaphore = dev.make_semaphore(sci.get<vk::SemaphoreCreateInfo>());
+}
+
+timeline_point timeline_queue::submit(vk::ArrayProxy<const vk::CommandBuffer> cbs, vk::ArrayProxy<const wait_info> waits, vk::ArrayProxy<const timeline_point> signals) {
+    std::vector<vk::Semaphore> wait_semaphores{};
+    std::vector<std::uint64_t> wait_values{};
+    std::vector<vk::PipelineStageFlags> wait_stages{};
+    for (const auto& w : waits) {
+        // default points are skipped so optional dependencies can be passed as they are
+        if (w.point.semaphore) {
+            wait_semaphores.push_back(w.point.semaphore);
+            wait_values.push_back(w.point.value);
+            wait_stages.push_back(w.stages);
+        }
+    }
+
+    const timeline_point next{*_semaphore, _submitted + 1};
+    std::vector<vk::Semaphore> signal_semaphores{next.semaphore};
+    std::vector<std::uint64_t> signal_values{next.value};
+    for (const auto& s : signals) {
+        signal_semaphores.push_back(s.semaphore);
+        signal_values.push_back(s.value);
+    }
+
+    vk::StructureChain<vk::SubmitInfo, vk::TimelineSemaphoreSubmitInfo> submit{
+        {wait_semaphores, wait_stages, cbs, signal_semaphores},
+        {wait_values, signal_values},
+    };
+    _queue.submit(submit.get<vk::SubmitInfo>());
+
+    _submitted = next.value;
+    return next;
+}
+
+timeline_point timeline_queue::last() const {
+    return {*_semaphore, _submitted};
+}
+
+timeline_point timeline_queue::at(std::uint64_t value) const {
+    return {*_semaphore, value};
+}
+
+std::uint64_t timeline_queue::completed() const {
+    return _semaphore.getCounterValue();
+}
+
+bool timeline_queue::wait(std::uint64_t value, std::uint64_t timeout) const {
+    const vk::Semaphore semaphore = *_semaphore;
+    const vk::SemaphoreWaitInfo info{{}, semaphore, value};
+    const auto result = static_cast<vk::Result>(_semaphore.getDispatcher()->vkWaitSemaphores(_semaphore.getDevice(), reinterpret_cast<const VkSemaphoreWaitInfo*>(&info), timeout));
+    if (result != vk::Result::eSuccess && result != vk::Result::eTimeout) {
+        throw std::runtime_error(fmt::format("waiting for timeline value {} failed: {}", value, vk::to_string(result)));
+    }
+    return result == vk::Result::eSuccess;
+}
+
+const vk::Queue& timeline_queue::queue() const {
+    return _queue;
+}
+
+} // namespace vulkan
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "vulkan.hpp"
+
+namespace vulkan {
+
+// a point of gpu work: the semaphore of the queue that ran it and the value its submit signaled.
+// a binary semaphore is a point with value 0, the value is ignored for those
+struct timeline_point {
+    vk::Semaphore semaphore{};
+    std::uint64_t value{};
+};
+
+// one timeline semaphore per queue. every submit signals the next value, so cross queue
+// dependencies are (queue, value) pairs and the cpu waits for values instead of fences.
+// needs device_features::timeline_semaphore. the host side calls go through the semaphore's
+// dispatcher, which resolves to the KHR entry points on a 1.1 device
+class timeline_queue {
+    vk::Queue _queue{nullptr};
+    vk::raii::Semaphore _semaphore{nullptr};
+    std::uint64_t _submitted{};
+
+  public:
+    struct wait_info {
+        timeline_point point;
+        vk::PipelineStageFlags stages;
+    };
+
+    timeline_queue() = default;
+    timeline_queue(const device& dev, const vk::Queue& queue);
+
+    // signals the next value and the extra points, e.g. a binary semaphore for present
+    timeline_point submit(vk::ArrayProxy<const vk::CommandBuffer> cbs, vk::ArrayProxy<const wait_info> waits = {}, vk::ArrayProxy<const timeline_point> signals = {});
+
+    // the point of the last submit, value 0 before the first one
+    timeline_point last() const;
+    // the point of an earlier submit, from a value last() returned before
+    timeline_point at(std::uint64_t value) const;
+    std::uint64_t completed() const;
+    // returns false on timeout
+    bool wait(std::uint64_t value, std::uint64_t timeout = ~std::uint64_t{}) const;
+
+    const vk::Queue& queue() const;
+};
+
+} // namespace vulkan
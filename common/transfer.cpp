@@ -0,0 +1,184 @@
+#include "transfer.hpp"
+#include "ring_buffer.hpp"
+
+namespace vulkan {
+
+transfer_token& transfer_token::operator=(transfer_token&& other) noexcept {
+    if (this != &other) {
+        wait();
+
+        _device = other._device;
+        _cb = std::move(other._cb);
+        _pool = std::move(other._pool);
+        _acquire_cb = std::move(other._acquire_cb);
+        _acquire_pool = std::move(other._acquire_pool);
+        _semaphore = std::move(other._semaphore);
+        _fence = std::move(other._fence);
+        _staging = std::move(other._staging);
+    }
+
+    return *this;
+}
+
+transfer_token::~transfer_token() {
+    wait();
+}
+
+bool transfer_token::ready() const {
+    return !*_fence || _fence.getStatus() == vk::Result::eSuccess;
+}
+
+void transfer_token::wait() const {
+    if (!*_fence) {
+        return;
+    }
+
+    while (vk::Result::eTimeout == _device.waitForFences(*_fence, vk::True, -1)) {
+    }
+}
+
+upload_batch::upload_batch(const device& dev, std::uint32_t owner)
+    : _device(&dev), _owner(owner == VK_QUEUE_FAMILY_IGNORED ? dev.graphic_queue_index() : owner) {}
+
+upload_batch::upload_batch(const device& dev, ring_buffer& ring, std::uint32_t owner)
+    : upload_batch(dev, owner) {
+    _ring = &ring;
+}
+
+const vk::CommandBuffer& upload_batch::begin() {
+    if (!*_cb) {
+        _pool = _device->make_command_pool({
+            vk::CommandPoolCreateFlagBits::eTransient,
+            _device->transfer_queue_index(),
+        });
+        _cb = std::move(_device->make_command_buffers({_pool, vk::CommandBufferLevel::ePrimary, 1}).front());
+        _cb.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    }
+
+    return *_cb;
+}
+
+bool upload_batch::transfers_ownership() const {
+    return _owner != _device->transfer_queue_index();
+}
+
+upload_batch& upload_batch::copy_buffers(const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size, vk::DeviceSize src_offset, vk::DeviceSize dst_offset) {
+    const auto& cb = begin();
+    utils::copy_buffers(cb, src, dst, size, src_offset, dst_offset);
+
+    if (transfers_ownership()) {
+        utils::release_ownership(cb, dst, _device->transfer_queue_index(), _owner);
+        _buffers.push_back(dst);
+    }
+
+    return *this;
+}
+
+upload_batch& upload_batch::copy_buffer_to_image(const vk::Buffer& buf, const vk::Image& img, vk::Extent3D extent, vk::ImageLayout new_layout, vk::DeviceSize offset) {
+    const auto& cb = begin();
+    if (!transfers_ownership()) {
+        utils::copy_buffer_to_image(cb, buf, img, extent, new_layout, offset);
+        return *this;
+    }
+
+    // the final layout transition is part of the ownership transfer
+    utils::image_transition(cb, img, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+    cb.copyBufferToImage(buf,
+                         img,
+                         vk::ImageLayout::eTransferDstOptimal,
+                         vk::BufferImageCopy{
+                             offset,
+                             0,
+                             0,
+                             {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+                             {0, 0, 0},
+                             extent,
+                         });
+    utils::release_ownership(cb, img, _device->transfer_queue_index(), _owner, vk::ImageLayout::eTransferDstOptimal, new_layout);
+    _images.push_back({img, vk::ImageLayout::eTransferDstOptimal, new_layout});
+
+    return *this;
+}
+
+upload_batch& upload_batch::image_transition(const vk::Image& img, vk::ImageLayout old_layout, vk::ImageLayout new_layout) {
+    const auto& cb = begin();
+    if (!transfers_ownership()) {
+        utils::image_transition(cb, img, old_layout, new_layout);
+        return *this;
+    }
+
+    utils::release_ownership(cb, img, _device->transfer_queue_index(), _owner, old_layout, new_layout);
+    _images.push_back({img, old_layout, new_layout});
+
+    return *this;
+}
+
+upload_batch& upload_batch::upload(const buffer& dst, const void* data, vk::DeviceSize size) {
+    if (const auto r = _ring ? _ring->push(data, size) : std::nullopt) {
+        return copy_buffers(r->buffer, dst.buf(), size, r->offset);
+    }
+
+    const auto& staging = _staging.emplace_back(*_device, size, vk::BufferUsageFlagBits::eTransferSrc, data);
+    return copy_buffers(staging.buf(), dst.buf(), size);
+}
+
+upload_batch& upload_batch::upload(const texture& dst, const void* data, vk::ImageLayout new_layout) {
+    const auto size = vk::DeviceSize{dst.width()} * dst.height() * 4;
+    if (const auto r = _ring ? _ring->push(data, size) : std::nullopt) {
+        return copy_buffer_to_image(r->buffer, dst.image(), dst.extent(), new_layout, r->offset);
+    }
+
+    const auto& staging = _staging.emplace_back(*_device, size, vk::BufferUsageFlagBits::eTransferSrc, data);
+    return copy_buffer_to_image(staging.buf(), dst.image(), dst.extent(), new_layout);
+}
+
+bool upload_batch::empty() const {
+    return !*_cb;
+}
+
+transfer_token upload_batch::submit() {
+    transfer_token token{};
+    token._device = _device->logical();
+
+    if (empty()) {
+        return token;
+    }
+
+    _cb.end();
+
+    token._fence = _device->make_fence({});
+
+    if (_images.empty() && _buffers.empty()) {
+        _device->transfer_queue().submit(vk::SubmitInfo{{}, {}, *_cb}, *token._fence);
+    } else {
+        const auto src = _device->transfer_queue_index();
+        token._semaphore = _device->make_semaphore({});
+        token._acquire_pool = _device->make_command_pool({vk::CommandPoolCreateFlagBits::eTransient, _owner});
+        token._acquire_cb = std::move(_device->make_command_buffers({token._acquire_pool, vk::CommandBufferLevel::ePrimary, 1}).front());
+
+        token._acquire_cb.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        for (const auto& [image, old_layout, new_layout] : _images) {
+            utils::acquire_ownership(*token._acquire_cb, image, src, _owner, old_layout, new_layout);
+        }
+        for (const auto& buffer : _buffers) {
+            utils::acquire_ownership(*token._acquire_cb, buffer, src, _owner);
+        }
+        token._acquire_cb.end();
+
+        const vk::PipelineStageFlags wait_stage{vk::PipelineStageFlagBits::eAllCommands};
+        _device->transfer_queue().submit(vk::SubmitInfo{{}, {}, *_cb, *token._semaphore});
+        _device->queue(_owner).submit(vk::SubmitInfo{*token._semaphore, wait_stage, *token._acquire_cb}, *token._fence);
+
+        _images.clear();
+        _buffers.clear();
+    }
+
+    token._cb = std::move(_cb);
+    token._pool = std::move(_pool);
+    token._staging = std::move(_staging);
+    _staging.clear();
+
+    return token;
+}
+
+} // namespace vulkan
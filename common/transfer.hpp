@@ -0,0 +1,79 @@
+#pragma once
+
+#include "vulkan.hpp"
+
+#include <vector>
+
+namespace vulkan {
+
+class ring_buffer;
+
+// keeps the command buffers and staging memory of a submitted batch alive
+// until the gpu is done with them
+class transfer_token {
+    vk::Device _device{};
+    vk::raii::CommandPool _pool{nullptr};
+    vk::raii::CommandBuffer _cb{nullptr};
+    vk::raii::CommandPool _acquire_pool{nullptr};
+    vk::raii::CommandBuffer _acquire_cb{nullptr};
+    vk::raii::Semaphore _semaphore{nullptr};
+    vk::raii::Fence _fence{nullptr};
+    std::vector<host_buffer> _staging{};
+
+    friend class upload_batch;
+
+  public:
+    transfer_token() = default;
+    transfer_token(const transfer_token&) = delete;
+    transfer_token& operator=(const transfer_token&) = delete;
+    transfer_token(transfer_token&& other) noexcept = default;
+    transfer_token& operator=(transfer_token&& other) noexcept;
+    ~transfer_token();
+
+    bool ready() const;
+    void wait() const;
+};
+
+// records any number of copies and layout transitions into a single
+// command buffer which is submitted once with a single fence.
+// the work runs on the transfer queue, when that is a different family than
+// the owner of the resources they are released at the end of the batch and
+// acquired by a second command buffer on the owner queue
+class upload_batch {
+    struct image_acquire {
+        vk::Image image;
+        vk::ImageLayout old_layout;
+        vk::ImageLayout new_layout;
+    };
+
+    const device* _device{nullptr};
+    ring_buffer* _ring{nullptr};
+    std::uint32_t _owner{};
+    vk::raii::CommandPool _pool{nullptr};
+    vk::raii::CommandBuffer _cb{nullptr};
+    std::vector<host_buffer> _staging{};
+    std::vector<image_acquire> _images{};
+    std::vector<vk::Buffer> _buffers{};
+
+    const vk::CommandBuffer& begin();
+    bool transfers_ownership() const;
+
+  public:
+    // owner defaults to the graphic queue family of the device
+    explicit upload_batch(const device& dev, std::uint32_t owner = VK_QUEUE_FAMILY_IGNORED);
+    // staging data is placed into the current frame of the ring while it has room
+    upload_batch(const device& dev, ring_buffer& ring, std::uint32_t owner = VK_QUEUE_FAMILY_IGNORED);
+
+    upload_batch& copy_buffers(const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size, vk::DeviceSize src_offset = 0, vk::DeviceSize dst_offset = 0);
+    upload_batch& copy_buffer_to_image(const vk::Buffer& buf, const vk::Image& img, vk::Extent3D extent, vk::ImageLayout new_layout, vk::DeviceSize offset = 0);
+    upload_batch& image_transition(const vk::Image& img, vk::ImageLayout old_layout, vk::ImageLayout new_layout);
+
+    upload_batch& upload(const buffer& dst, const void* data, vk::DeviceSize size);
+    upload_batch& upload(const texture& dst, const void* data, vk::ImageLayout new_layout);
+
+    bool empty() const;
+
+    [[nodiscard]] transfer_token submit();
+};
+
+} // namespace vulkan
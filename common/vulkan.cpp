@@ -1,6 +1,10 @@
 #include "vulkan.hpp"
+#include "transfer.hpp"
 
-#include <set>
+#include <algorithm>
+#include <bitset>
+#include <limits>
+#include <string_view>
 
 #include <fmt/core.h>
 
@@ -18,7 +22,7 @@ device::device(const vk::ApplicationInfo& app_info,
                const vk::ArrayProxy<const char*>& layers,
                const vk::ArrayProxy<const char*>& device_extensions,
                const vk::ArrayProxy<const char*>& instance_extensions,
-               vk::QueueFlags queues, bool debug) : device() {
+               vk::QueueFlags queues, bool debug, device_features requested) : device() {
     _instance = {
         _context,
         vk::InstanceCreateInfo{{}, &app_info, layers, instance_extensions},
@@ -36,57 +40,175 @@ device::device(const vk::ApplicationInfo& app_info,
         _dbg_msgr = {_instance, debug_ci};
     }
 
-    std::set<std::uint32_t> indices{};
+    const auto families = _physical_dev.getQueueFamilyProperties();
+
+    // compute and transfer land on dedicated families when the device has them,
+    // a role that was not requested shares the family of the other one
+    const auto graphics = static_cast<bool>(queues & vk::QueueFlagBits::eGraphics);
+    const auto compute = static_cast<bool>(queues & vk::QueueFlagBits::eCompute);
+    _graphic_queue_index = queue_family_index(graphics ? vk::QueueFlagBits::eGraphics : vk::QueueFlagBits::eCompute);
+    _compute_queue_index = compute ? queue_family_index(vk::QueueFlagBits::eCompute) : _graphic_queue_index;
+    _transfer_queue_index = queue_family_index(vk::QueueFlagBits::eTransfer);
+
+    // every role gets its own queue while the family has enough of them
+    std::map<std::uint32_t, std::uint32_t> counts{};
+    const auto slot = [&counts, &families](std::uint32_t family) {
+        const auto n = counts[family]++;
+        return std::min(n, families[family].queueCount - 1);
+    };
+    const auto graphic_slot = slot(_graphic_queue_index);
+    const auto compute_slot = slot(_compute_queue_index);
+    const auto transfer_slot = slot(_transfer_queue_index);
 
-    if (queues & vk::QueueFlagBits::eGraphics) {
-        const auto index = queue_family_index(vk::QueueFlagBits::eGraphics);
-        indices.insert(index);
+    // the first queue of a family has the highest priority
+    std::vector<std::vector<float>> priorities{};
+    std::vector<vk::DeviceQueueCreateInfo> queue_ci;
+    priorities.reserve(counts.size());
+    for (const auto [family, count] : counts) {
+        auto& p = priorities.emplace_back(std::min(count, families[family].queueCount), 0.5f);
+        p.front() = 1.0f;
+        queue_ci.emplace_back(vk::DeviceQueueCreateFlags(), family, static_cast<std::uint32_t>(p.size()), p.data());
     }
 
-    if (queues & vk::QueueFlagBits::eCompute) {
-        const auto index = queue_family_index(vk::QueueFlagBits::eCompute);
-        indices.insert(index);
+    std::vector<const char*> extensions(device_extensions.begin(), device_extensions.end());
+    vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR, vk::PhysicalDeviceTimelineSemaphoreFeatures> device_ci{};
+
+    // the version the device is used at, features of a later one need their extension
+    const auto version = std::min(app_info.apiVersion, _physical_dev.getProperties().apiVersion);
+    const auto available = _physical_dev.enumerateDeviceExtensionProperties();
+    const auto has_extension = [&available](std::string_view name) {
+        return std::any_of(available.begin(), available.end(), [name](const vk::ExtensionProperties& e) {
+            return std::string_view{e.extensionName.data()} == name;
+        });
+    };
+
+    // the feature structs stay in the chain only when something in them is enabled
+    if (requested.float16 && version >= VK_API_VERSION_1_1) {
+        if (has_extension(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME)) {
+            const auto supported = _physical_dev.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR>();
+            _features.float16 = supported.get<vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR>().shaderFloat16;
+        }
+    }
+    // the fp16 kernels keep their halves in shared memory and registers, no buffer has
+    // 16 bit members, so 16 bit storage is not requested
+    if (_features.float16) {
+        device_ci.get<vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR>().shaderFloat16 = true;
+        extensions.push_back(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+    } else {
+        device_ci.unlink<vk::PhysicalDeviceShaderFloat16Int8FeaturesKHR>();
     }
 
-    if (queues & vk::QueueFlagBits::eTransfer) {
-        const auto index = queue_family_index(vk::QueueFlagBits::eTransfer);
-        indices.insert(index);
+    // core in 1.2, a 1.1 device gets VK_KHR_timeline_semaphore
+    const auto timeline_core = version >= VK_API_VERSION_1_2;
+    if (requested.timeline_semaphore && version >= VK_API_VERSION_1_1 && (timeline_core || has_extension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME))) {
+        const auto supported = _physical_dev.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceTimelineSemaphoreFeatures>();
+        _features.timeline_semaphore = supported.get<vk::PhysicalDeviceTimelineSemaphoreFeatures>().timelineSemaphore;
+    }
+    if (_features.timeline_semaphore) {
+        device_ci.get<vk::PhysicalDeviceTimelineSemaphoreFeatures>().timelineSemaphore = true;
+        if (!timeline_core) {
+            extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        }
+    } else {
+        device_ci.unlink<vk::PhysicalDeviceTimelineSemaphoreFeatures>();
     }
 
-    const auto priority{1.0f};
-    std::vector<vk::DeviceQueueCreateInfo> queue_ci;
-    for (const auto i : indices) {
-        queue_ci.emplace_back(vk::DeviceQueueCreateFlags(), i, 1, &priority);
+    device_ci.get<vk::DeviceCreateInfo>().setQueueCreateInfos(queue_ci).setPEnabledLayerNames(layers).setPEnabledExtensionNames(extensions);
+    _logical_dev = {_physical_dev, device_ci.get<vk::DeviceCreateInfo>()};
+
+    for (const auto& ci : queue_ci) {
+        auto& list = _queues[ci.queueFamilyIndex];
+        for (std::uint32_t i = 0; i < ci.queueCount; ++i) {
+            list.emplace_back(_logical_dev.getQueue(ci.queueFamilyIndex, i));
+        }
     }
 
-    vk::DeviceCreateInfo device_ci{{}, queue_ci, layers, device_extensions};
-    _logical_dev = {_physical_dev, device_ci};
+    _graphic_queue = queue(_graphic_queue_index, graphic_slot);
+    _compute_queue = queue(_compute_queue_index, compute_slot);
+    _transfer_queue = queue(_transfer_queue_index, transfer_slot);
 
-    _graphic_queue = _logical_dev.getQueue(queue_family_index(vk::QueueFlagBits::eGraphics), 0);
-    _compute_queue = _logical_dev.getQueue(queue_family_index(vk::QueueFlagBits::eCompute), 0);
+    _allocator = std::make_unique<allocator>(*_physical_dev, *_logical_dev);
 }
 
 std::uint32_t device::queue_family_index(vk::QueueFlags flags) const {
+    constexpr vk::QueueFlags kinds{vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute | vk::QueueFlagBits::eTransfer};
+
+    // prefer the family which supports the fewest capabilities besides the requested ones
     const auto props = _physical_dev.getQueueFamilyProperties();
-    const auto iter = std::find_if(props.begin(), props.end(), [flags](auto p) {
-        return p.queueFlags & flags;
-    });
+    auto best = props.size();
+    auto best_extra = std::numeric_limits<std::size_t>::max();
+    for (std::size_t i = 0; i < props.size(); ++i) {
+        auto caps = props[i].queueFlags;
+        if (caps & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) {
+            caps |= vk::QueueFlagBits::eTransfer;
+        }
+
+        if ((caps & flags) != flags) {
+            continue;
+        }
 
-    if (iter == props.end()) {
+        const auto extra = std::bitset<32>(static_cast<VkQueueFlags>(caps & kinds & ~flags)).count();
+        if (extra < best_extra) {
+            best = i;
+            best_extra = extra;
+        }
+    }
+
+    if (best == props.size()) {
         throw std::runtime_error(fmt::format("failed to get {} queue index", vk::to_string(flags)));
     }
 
-    return std::distance(props.begin(), iter);
+    return best;
 }
 
 std::uint32_t device::memory_type_index(std::uint32_t filter, vk::MemoryPropertyFlags mask) const {
+    return memory_type_index(filter, mask, {}, {});
+}
+
+std::uint32_t device::memory_type_index(std::uint32_t filter, memory_usage usage) const {
+    using flag = vk::MemoryPropertyFlagBits;
+
+    switch (usage) {
+    case memory_usage::upload:
+        return memory_type_index(filter, flag::eHostVisible, flag::eHostCoherent, flag::eHostCached | flag::eDeviceLocal);
+    case memory_usage::readback:
+        return memory_type_index(filter, flag::eHostVisible, flag::eHostCached | flag::eHostCoherent, flag::eDeviceLocal);
+    case memory_usage::dynamic:
+        return memory_type_index(filter, flag::eHostVisible, flag::eDeviceLocal | flag::eHostCoherent, flag::eHostCached);
+    case memory_usage::gpu_only:
+    default:
+        return memory_type_index(filter, flag::eDeviceLocal, {}, flag::eHostVisible);
+    }
+}
+
+std::uint32_t device::memory_type_index(std::uint32_t filter, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred, vk::MemoryPropertyFlags avoided) const {
+    const auto count = [](vk::MemoryPropertyFlags flags) {
+        return static_cast<int>(std::bitset<32>(static_cast<VkMemoryPropertyFlags>(flags)).count());
+    };
+
     const auto props = _physical_dev.getMemoryProperties();
+
+    auto best = std::numeric_limits<std::uint32_t>::max();
+    auto best_score = std::numeric_limits<int>::min();
     for (std::uint32_t i = 0; i < props.memoryTypeCount; ++i) {
-        if (filter & (1 << i) && ((props.memoryTypes[i].propertyFlags & mask) == mask)) {
-            return i;
+        const auto flags = props.memoryTypes[i].propertyFlags;
+        if (!(filter & (1u << i)) || (flags & required) != required) {
+            continue;
+        }
+
+        // ties keep the lower index, the order the driver recommends
+        const auto score = 2 * count(flags & preferred) - count(flags & avoided);
+        if (score > best_score) {
+            best = i;
+            best_score = score;
         }
     }
-    throw std::runtime_error("failed to find memory type");
+
+    if (best == std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("failed to find memory type");
+    }
+
+    return best;
 }
 
 const vk::PhysicalDevice& device::physical() const {
@@ -101,12 +223,42 @@ const vk::Device& device::logical() const {
     return *_logical_dev;
 }
 
+const device_features& device::features() const {
+    return _features;
+}
+
 const vk::Queue& device::graphic_queue() const {
-    return *_graphic_queue;
+    return _graphic_queue;
 }
 
 const vk::Queue& device::compute_queue() const {
-    return *_compute_queue;
+    return _compute_queue;
+}
+
+const vk::Queue& device::transfer_queue() const {
+    return _transfer_queue;
+}
+
+std::uint32_t device::graphic_queue_index() const {
+    return _graphic_queue_index;
+}
+
+std::uint32_t device::compute_queue_index() const {
+    return _compute_queue_index;
+}
+
+std::uint32_t device::transfer_queue_index() const {
+    return _transfer_queue_index;
+}
+
+const vk::Queue& device::queue(std::uint32_t family, std::uint32_t index) const {
+    const auto& list = _queues.at(family);
+    return *list[std::min<std::size_t>(index, list.size() - 1)];
+}
+
+std::uint32_t device::queue_count(std::uint32_t family) const {
+    const auto iter = _queues.find(family);
+    return iter == _queues.end() ? 0 : iter->second.size();
 }
 
 const vk::Queue& device::present_queue() const {
@@ -121,6 +273,20 @@ vk::raii::DeviceMemory device::make_memory(const vk::MemoryAllocateInfo& info) c
     return _logical_dev.allocateMemory(info);
 }
 
+allocation device::allocate_memory(const vk::MemoryRequirements& req, vk::MemoryPropertyFlags mask, bool dedicated) const {
+    const auto index = memory_type_index(req.memoryTypeBits, mask);
+    return _allocator->allocate(req, index, dedicated);
+}
+
+allocation device::allocate_memory(const vk::MemoryRequirements& req, memory_usage usage, bool dedicated) const {
+    const auto index = memory_type_index(req.memoryTypeBits, usage);
+    return _allocator->allocate(req, index, dedicated);
+}
+
+allocator::statistics device::memory_statistics() const {
+    return _allocator->stats();
+}
+
 vk::raii::Image device::make_image(const vk::ImageCreateInfo& info) const {
     return _logical_dev.createImage(info);
 }
@@ -165,6 +331,10 @@ vk::raii::Semaphore device::make_semaphore(const vk::SemaphoreCreateInfo& info)
     return {_logical_dev, info};
 }
 
+vk::raii::QueryPool device::make_query_pool(const vk::QueryPoolCreateInfo& info) const {
+    return {_logical_dev, info};
+}
+
 vk::raii::DescriptorSetLayout device::make_descriptor_set_layout(const vk::DescriptorSetLayoutCreateInfo& info) const {
     return {_logical_dev, info};
 }
@@ -194,68 +364,31 @@ vk::raii::PipelineLayout device::make_pipeline_layout(const vk::PipelineLayoutCr
 }
 
 void device::copy_buffers(const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size) const {
-    const auto i = queue_family_index(vk::QueueFlagBits::eTransfer);
-    const auto q = _logical_dev.getQueue(i, 0);
-    const auto pool = make_command_pool({
-        vk::CommandPoolCreateFlagBits::eTransient,
-        i,
-    });
-
-    const auto cb = std::move(make_command_buffers({pool, vk::CommandBufferLevel::ePrimary, 1}).front());
-    cb.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-    utils::copy_buffers(cb, src, dst, size);
-    cb.end();
-
-    q.submit(vk::SubmitInfo{{}, {}, *cb});
-    q.waitIdle();
+    upload_batch{*this}.copy_buffers(src, dst, size).submit().wait();
 }
 
 void device::copy_buffer_to_image(const vk::Buffer& buf, const vk::Image& img, vk::Extent3D extent, vk::ImageLayout new_layout) const {
-    const auto i = queue_family_index(vk::QueueFlagBits::eTransfer);
-    const auto q = _logical_dev.getQueue(i, 0);
-    const auto pool = make_command_pool({
-        vk::CommandPoolCreateFlagBits::eTransient,
-        i,
-    });
-
-    const auto cb = std::move(make_command_buffers({pool, vk::CommandBufferLevel::ePrimary, 1}).front());
-
-    cb.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-    utils::copy_buffer_to_image(cb, buf, img, extent, new_layout);
-    cb.end();
-
-    q.submit(vk::SubmitInfo{{}, {}, *cb});
-    q.waitIdle();
+    upload_batch{*this}.copy_buffer_to_image(buf, img, extent, new_layout).submit().wait();
 }
 
 void device::image_transition(const vk::Image& img, vk::ImageLayout old_layout, vk::ImageLayout new_layout) const {
-    const auto i = queue_family_index(vk::QueueFlagBits::eTransfer);
-    const auto q = _logical_dev.getQueue(i, 0);
-    const auto pool = make_command_pool({
-        vk::CommandPoolCreateFlagBits::eTransient,
-        i,
-    });
-
-    const auto cb = std::move(make_command_buffers({pool, vk::CommandBufferLevel::ePrimary, 1}).front());
-
-    cb.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
-    utils::image_transition(cb, img, old_layout, new_layout);
-    cb.end();
-
-    q.submit(vk::SubmitInfo{{}, {}, *cb});
-    q.waitIdle();
+    upload_batch{*this}.image_transition(img, old_layout, new_layout).submit().wait();
 }
 
 buffer::buffer(const device& device, vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags mask) : _size(size) {
     vk::BufferCreateInfo ci{{}, size, usage, vk::SharingMode::eExclusive};
     _buf = device.make_buffer(ci);
 
-    const auto req = _buf.getMemoryRequirements();
-    const auto index = device.memory_type_index(req.memoryTypeBits, mask);
+    _mem = device.allocate_memory(_buf.getMemoryRequirements(), mask);
+    _buf.bindMemory(_mem.memory(), _mem.offset());
+}
+
+buffer::buffer(const device& device, vk::DeviceSize size, vk::BufferUsageFlags usage, memory_usage placement) : _size(size) {
+    vk::BufferCreateInfo ci{{}, size, usage, vk::SharingMode::eExclusive};
+    _buf = device.make_buffer(ci);
 
-    vk::MemoryAllocateInfo ai{req.size, index};
-    _mem = device.make_memory(ai);
-    _buf.bindMemory(_mem, 0);
+    _mem = device.allocate_memory(_buf.getMemoryRequirements(), placement);
+    _buf.bindMemory(_mem.memory(), _mem.offset());
 }
 
 const vk::Buffer& buffer::buf() const {
@@ -263,7 +396,11 @@ const vk::Buffer& buffer::buf() const {
 }
 
 const vk::DeviceMemory& buffer::mem() const {
-    return *_mem;
+    return _mem.memory();
+}
+
+vk::DeviceSize buffer::offset() const {
+    return _mem.offset();
 }
 
 const vk::DeviceSize buffer::size() const {
@@ -271,11 +408,18 @@ const vk::DeviceSize buffer::size() const {
 }
 
 device_buffer::device_buffer(const device& device, vk::DeviceSize size, vk::BufferUsageFlags usage)
-    : buffer(device, size, usage, vk::MemoryPropertyFlagBits::eDeviceLocal) {}
+    : buffer(device, size, usage, memory_usage::gpu_only) {}
 
 host_buffer::host_buffer(const device& device, vk::DeviceSize size, vk::BufferUsageFlags usage, const void* data)
-    : buffer(device, size, usage, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached) {
-    _mapped = _mem.mapMemory(0, size);
+    : host_buffer(device, size, usage, memory_usage::upload, data) {}
+
+host_buffer::host_buffer(const device& device, vk::DeviceSize size, vk::BufferUsageFlags usage, memory_usage placement, const void* data)
+    : buffer(device, size, usage, placement) {
+    if (placement == memory_usage::gpu_only) {
+        throw std::runtime_error("host buffer needs host visible memory");
+    }
+
+    _mapped = _mem.mapped();
 
     if (data) {
         copy(data, size);
@@ -284,12 +428,26 @@ host_buffer::host_buffer(const device& device, vk::DeviceSize size, vk::BufferUs
 
 void host_buffer::copy(const void* data, vk::DeviceSize size) const {
     std::memcpy(_mapped, data, size);
+    _mem.flush(0, size);
 }
 
 void host_buffer::copy_to(void* data, vk::DeviceSize size) const {
+    _mem.invalidate(0, size);
     std::memcpy(data, _mapped, size);
 }
 
+void host_buffer::flush(vk::DeviceSize offset, vk::DeviceSize size) const {
+    _mem.flush(offset, size);
+}
+
+void host_buffer::invalidate(vk::DeviceSize offset, vk::DeviceSize size) const {
+    _mem.invalidate(offset, size);
+}
+
+void* host_buffer::mapped() const {
+    return _mapped;
+}
+
 texture::texture(const device& device, std::uint32_t width, std::uint32_t height)
     : texture(device, width, height, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst) {}
 
@@ -310,12 +468,8 @@ texture::texture(const device& device, std::uint32_t width, std::uint32_t height
 
     _img = device.make_image(ici);
 
-    const auto req = _img.getMemoryRequirements();
-    const auto index = device.memory_type_index(req.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
-
-    vk::MemoryAllocateInfo mai{req.size, index};
-    _mem = device.make_memory(mai);
-    _img.bindMemory(_mem, 0);
+    _mem = device.allocate_memory(_img.getMemoryRequirements(), memory_usage::gpu_only);
+    _img.bindMemory(_mem.memory(), _mem.offset());
 
     vk::ImageViewCreateInfo ivci{
         {},
@@ -360,13 +514,37 @@ std::uint32_t texture::height() const {
     return _height;
 }
 
-swapchain::swapchain(const device& device, const vk::SurfaceKHR& surf, std::uint32_t w, std::uint32_t h) {
+namespace {
+
+vk::PresentModeKHR pick_present_mode(const std::vector<vk::PresentModeKHR>& available, vk::PresentModeKHR requested) {
+    std::vector<vk::PresentModeKHR> order{requested};
+    if (requested == vk::PresentModeKHR::eMailbox) {
+        order.push_back(vk::PresentModeKHR::eImmediate);
+    } else if (requested == vk::PresentModeKHR::eImmediate) {
+        order.push_back(vk::PresentModeKHR::eMailbox);
+    }
+
+    for (const auto mode : order) {
+        if (std::find(available.begin(), available.end(), mode) != available.end()) {
+            return mode;
+        }
+    }
+    return vk::PresentModeKHR::eFifo;
+}
+
+} // namespace
+
+swapchain::swapchain(const device& device, const vk::SurfaceKHR& surf, std::uint32_t w, std::uint32_t h, swapchain_config config)
+    : _config(config) {
     _surface = device.make_surface(surf);
 
-    resize(device, w, h);
+    (void)resize(device, w, h);
 }
 
-void swapchain::resize(const device& device, std::uint32_t w, std::uint32_t h) {
+swapchain::retired swapchain::resize(const device& device, std::uint32_t w, std::uint32_t h) {
+    retired old{std::move(_swapchain), std::move(_image_views)};
+    _image_views.clear();
+
     const auto formats = device.physical().getSurfaceFormatsKHR(_surface);
     _format = formats[0];
     for (const auto& f : formats) {
@@ -383,12 +561,16 @@ void swapchain::resize(const device& device, std::uint32_t w, std::uint32_t h) {
 
     const auto pre_transform = capabilities.currentTransform;
     const auto composite_alpha = vk::CompositeAlphaFlagBitsKHR::eOpaque;
-    const auto present_mode = vk::PresentModeKHR::eFifo;
+    _present_mode = pick_present_mode(device.physical().getSurfacePresentModesKHR(_surface), _config.present_mode);
+
+    // a max of 0 means no upper limit
+    const auto max_images = capabilities.maxImageCount ? capabilities.maxImageCount : std::numeric_limits<std::uint32_t>::max();
+    const auto image_count = std::clamp(_config.image_count ? _config.image_count : capabilities.minImageCount + 1, capabilities.minImageCount, max_images);
 
     vk::SwapchainCreateInfoKHR sci{
         {},
         _surface,
-        capabilities.minImageCount + 1,
+        image_count,
         _format.format,
         _format.colorSpace,
         _extent,
@@ -398,9 +580,9 @@ void swapchain::resize(const device& device, std::uint32_t w, std::uint32_t h) {
         nullptr,
         pre_transform,
         composite_alpha,
-        present_mode,
+        _present_mode,
         true,
-        _swapchain,
+        *old.swapchain,
     };
 
     _swapchain = device.make_swapchain(sci);
@@ -420,11 +602,12 @@ void swapchain::resize(const device& device, std::uint32_t w, std::uint32_t h) {
     };
 
     const auto images = _swapchain.getImages();
-    _image_views.clear();
     for (const auto& image : images) {
         ci.image = image;
         _image_views.emplace_back(device.make_image_view(ci));
     }
+
+    return old;
 }
 
 const vk::SwapchainKHR& swapchain::get() const {
@@ -439,6 +622,10 @@ vk::Extent2D swapchain::extent() const {
     return _extent;
 }
 
+vk::PresentModeKHR swapchain::present_mode() const {
+    return _present_mode;
+}
+
 std::vector<vk::ImageView> swapchain::image_views() const {
     std::vector<vk::ImageView> views{};
     for (const auto& iv : _image_views) {
@@ -448,12 +635,16 @@ std::vector<vk::ImageView> swapchain::image_views() const {
 }
 
 std::pair<vk::Result, std::uint32_t> swapchain::acquire_next(std::uint64_t timeout, const vk::Semaphore& semaphore, const vk::Fence& fence) const {
-    return _swapchain.acquireNextImage(timeout, semaphore, fence);
+    try {
+        return _swapchain.acquireNextImage(timeout, semaphore, fence);
+    } catch (const vk::OutOfDateKHRError&) {
+        return {vk::Result::eErrorOutOfDateKHR, 0};
+    }
 }
 
 namespace utils {
-void copy_buffers(const vk::CommandBuffer& cb, const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size) {
-    cb.copyBuffer(src, dst, {{0, 0, size}});
+void copy_buffers(const vk::CommandBuffer& cb, const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size, vk::DeviceSize src_offset, vk::DeviceSize dst_offset) {
+    cb.copyBuffer(src, dst, {{src_offset, dst_offset, size}});
 }
 
 void image_transition(const vk::CommandBuffer& cb, const vk::Image& img, vk::ImageLayout old_layout, vk::ImageLayout new_layout) {
@@ -505,14 +696,14 @@ void image_transition(const vk::CommandBuffer& cb, const vk::Image& img, vk::Ima
     cb.pipelineBarrier(src_stage, dst_stage, {}, {}, {}, barrier);
 }
 
-void copy_buffer_to_image(const vk::CommandBuffer& cb, const vk::Buffer& buf, const vk::Image& img, vk::Extent3D extent, vk::ImageLayout new_layout) {
+void copy_buffer_to_image(const vk::CommandBuffer& cb, const vk::Buffer& buf, const vk::Image& img, vk::Extent3D extent, vk::ImageLayout new_layout, vk::DeviceSize offset) {
     image_transition(cb, img, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
 
     cb.copyBufferToImage(buf,
                          img,
                          vk::ImageLayout::eTransferDstOptimal,
                          vk::BufferImageCopy{
-                             0,
+                             offset,
                              0,
                              0,
                              {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
@@ -523,6 +714,64 @@ void copy_buffer_to_image(const vk::CommandBuffer& cb, const vk::Buffer& buf, co
     image_transition(cb, img, vk::ImageLayout::eTransferDstOptimal, new_layout);
 }
 
+void release_ownership(const vk::CommandBuffer& cb, const vk::Image& img, std::uint32_t src_family, std::uint32_t dst_family, vk::ImageLayout old_layout, vk::ImageLayout new_layout) {
+    vk::ImageMemoryBarrier barrier{
+        vk::AccessFlagBits::eMemoryWrite,
+        {},
+        old_layout,
+        new_layout,
+        src_family,
+        dst_family,
+        img,
+        {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1},
+    };
+
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, barrier);
+}
+
+void acquire_ownership(const vk::CommandBuffer& cb, const vk::Image& img, std::uint32_t src_family, std::uint32_t dst_family, vk::ImageLayout old_layout, vk::ImageLayout new_layout) {
+    vk::ImageMemoryBarrier barrier{
+        {},
+        vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite,
+        old_layout,
+        new_layout,
+        src_family,
+        dst_family,
+        img,
+        {vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1},
+    };
+
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {}, barrier);
+}
+
+void release_ownership(const vk::CommandBuffer& cb, const vk::Buffer& buf, std::uint32_t src_family, std::uint32_t dst_family) {
+    vk::BufferMemoryBarrier barrier{
+        vk::AccessFlagBits::eMemoryWrite,
+        {},
+        src_family,
+        dst_family,
+        buf,
+        0,
+        VK_WHOLE_SIZE,
+    };
+
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, barrier, {});
+}
+
+void acquire_ownership(const vk::CommandBuffer& cb, const vk::Buffer& buf, std::uint32_t src_family, std::uint32_t dst_family) {
+    vk::BufferMemoryBarrier barrier{
+        {},
+        vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite,
+        src_family,
+        dst_family,
+        buf,
+        0,
+        VK_WHOLE_SIZE,
+    };
+
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, {}, barrier, {});
+}
+
 } // namespace utils
 
 } // namespace vulkan
@@ -1,11 +1,30 @@
 #pragma once
 
+#include "allocator.hpp"
+
 #include <cstdint>
+#include <map>
 
 #include <vulkan/vulkan_raii.hpp>
 
 namespace vulkan {
 
+// placement intent of a resource, picks the memory type for it
+enum class memory_usage {
+    gpu_only, // device local, never mapped
+    upload,   // host visible write-combined, written once and read by the gpu
+    readback, // host visible cached, written by the gpu and read by the host
+    dynamic,  // device local host visible (rebar/uma) when available, upload memory otherwise
+};
+
+// optional features, each is only enabled when the physical device supports it
+struct device_features {
+    // float16 arithmetic in shaders, needs vulkan 1.1
+    bool float16{false};
+    // timeline semaphores, core in vulkan 1.2 and through VK_KHR_timeline_semaphore on 1.1
+    bool timeline_semaphore{false};
+};
+
 class device {
     vk::raii::Context _context;
     vk::raii::Instance _instance{nullptr};
@@ -13,9 +32,19 @@ class device {
     vk::raii::PhysicalDevice _physical_dev{nullptr};
     vk::raii::Device _logical_dev{nullptr};
 
-    vk::raii::Queue _graphic_queue{nullptr};
+    std::map<std::uint32_t, std::vector<vk::raii::Queue>> _queues{};
+
+    vk::Queue _graphic_queue{nullptr};
     vk::raii::Queue _present_queue{nullptr};
-    vk::raii::Queue _compute_queue{nullptr};
+    vk::Queue _compute_queue{nullptr};
+    vk::Queue _transfer_queue{nullptr};
+
+    std::uint32_t _graphic_queue_index{};
+    std::uint32_t _compute_queue_index{};
+    std::uint32_t _transfer_queue_index{};
+
+    std::unique_ptr<allocator> _allocator;
+    device_features _features{};
 
   public:
     device() = default;
@@ -23,7 +52,7 @@ class device {
            const vk::ArrayProxy<const char*>& layers,
            const vk::ArrayProxy<const char*>& device_extensions,
            const vk::ArrayProxy<const char*>& instance_extensions,
-           vk::QueueFlags queues, bool debug);
+           vk::QueueFlags queues, bool debug, device_features requested = {});
 
     static VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT,
                                                          VkDebugUtilsMessageTypeFlagsEXT,
@@ -32,17 +61,34 @@ class device {
 
     std::uint32_t queue_family_index(vk::QueueFlags flags) const;
     std::uint32_t memory_type_index(std::uint32_t filter, vk::MemoryPropertyFlags mask) const;
+    std::uint32_t memory_type_index(std::uint32_t filter, memory_usage usage) const;
+    // types missing a required flag are skipped, the rest are scored by preferred and avoided flags
+    std::uint32_t memory_type_index(std::uint32_t filter, vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred, vk::MemoryPropertyFlags avoided) const;
 
     const vk::PhysicalDevice& physical() const;
     const vk::Instance& instance() const;
     const vk::Device& logical() const;
+    // the requested features the device ended up with
+    const device_features& features() const;
 
     const vk::Queue& graphic_queue() const;
     const vk::Queue& present_queue() const;
     const vk::Queue& compute_queue() const;
+    const vk::Queue& transfer_queue() const;
+
+    std::uint32_t graphic_queue_index() const;
+    std::uint32_t compute_queue_index() const;
+    std::uint32_t transfer_queue_index() const;
+
+    // queues of a family are ordered by priority, index is clamped to the queue count
+    const vk::Queue& queue(std::uint32_t family, std::uint32_t index = 0) const;
+    std::uint32_t queue_count(std::uint32_t family) const;
 
     vk::raii::Buffer make_buffer(const vk::BufferCreateInfo info) const;
     vk::raii::DeviceMemory make_memory(const vk::MemoryAllocateInfo& info) const;
+    allocation allocate_memory(const vk::MemoryRequirements& req, vk::MemoryPropertyFlags mask, bool dedicated = false) const;
+    allocation allocate_memory(const vk::MemoryRequirements& req, memory_usage usage, bool dedicated = false) const;
+    allocator::statistics memory_statistics() const;
     vk::raii::Image make_image(const vk::ImageCreateInfo& info) const;
     vk::raii::ImageView make_image_view(const vk::ImageViewCreateInfo& info) const;
     vk::raii::Sampler make_sampler(const vk::SamplerCreateInfo& info) const;
@@ -58,6 +104,7 @@ class device {
 
     vk::raii::Fence make_fence(const vk::FenceCreateInfo& info) const;
     vk::raii::Semaphore make_semaphore(const vk::SemaphoreCreateInfo& info) const;
+    vk::raii::QueryPool make_query_pool(const vk::QueryPoolCreateInfo& info) const;
 
     vk::raii::DescriptorSetLayout make_descriptor_set_layout(const vk::DescriptorSetLayoutCreateInfo& info) const;
     vk::raii::DescriptorPool make_descriptor_pool(const vk::DescriptorPoolCreateInfo& info) const;
@@ -74,23 +121,32 @@ class device {
 };
 
 namespace utils {
-void copy_buffers(const vk::CommandBuffer& cb, const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size);
-void copy_buffer_to_image(const vk::CommandBuffer& cb, const vk::Buffer& buf, const vk::Image& img, vk::Extent3D extent, vk::ImageLayout new_layout);
+void copy_buffers(const vk::CommandBuffer& cb, const vk::Buffer& src, const vk::Buffer& dst, vk::DeviceSize size, vk::DeviceSize src_offset = 0, vk::DeviceSize dst_offset = 0);
+void copy_buffer_to_image(const vk::CommandBuffer& cb, const vk::Buffer& buf, const vk::Image& img, vk::Extent3D extent, vk::ImageLayout new_layout, vk::DeviceSize offset = 0);
 void image_transition(const vk::CommandBuffer& cb, const vk::Image& img, vk::ImageLayout old_layout, vk::ImageLayout new_layout);
+
+// queue family ownership transfer of exclusive resources, the release half is
+// recorded on the source family and the matching acquire half on the destination one
+void release_ownership(const vk::CommandBuffer& cb, const vk::Image& img, std::uint32_t src_family, std::uint32_t dst_family, vk::ImageLayout old_layout, vk::ImageLayout new_layout);
+void acquire_ownership(const vk::CommandBuffer& cb, const vk::Image& img, std::uint32_t src_family, std::uint32_t dst_family, vk::ImageLayout old_layout, vk::ImageLayout new_layout);
+void release_ownership(const vk::CommandBuffer& cb, const vk::Buffer& buf, std::uint32_t src_family, std::uint32_t dst_family);
+void acquire_ownership(const vk::CommandBuffer& cb, const vk::Buffer& buf, std::uint32_t src_family, std::uint32_t dst_family);
 } // namespace utils
 
 class buffer {
   protected:
     vk::raii::Buffer _buf{nullptr};
-    vk::raii::DeviceMemory _mem{nullptr};
+    allocation _mem;
     vk::DeviceSize _size;
 
   public:
     buffer() = default;
     buffer(const device& dev, vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags mask);
+    buffer(const device& dev, vk::DeviceSize size, vk::BufferUsageFlags usage, memory_usage placement);
 
     const vk::Buffer& buf() const;
     const vk::DeviceMemory& mem() const;
+    vk::DeviceSize offset() const;
     const vk::DeviceSize size() const;
 };
 
@@ -106,15 +162,22 @@ class host_buffer : public buffer {
   public:
     host_buffer() = default;
     host_buffer(const device& dev, vk::DeviceSize size, vk::BufferUsageFlags usage, const void* data = nullptr);
+    host_buffer(const device& dev, vk::DeviceSize size, vk::BufferUsageFlags usage, memory_usage placement, const void* data = nullptr);
 
     void copy(const void* data, vk::DeviceSize size) const;
     void copy_to(void* data, vk::DeviceSize size) const;
+
+    // only needed after writing or before reading through mapped()
+    void flush(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+    void invalidate(vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE) const;
+
+    void* mapped() const;
 };
 
 class texture {
     vk::raii::Image _img{nullptr};
     vk::raii::ImageView _view{nullptr};
-    vk::raii::DeviceMemory _mem{nullptr};
+    allocation _mem;
     vk::raii::Sampler _sampler{nullptr};
     vk::Extent3D _extent{};
     std::uint32_t _width;
@@ -137,24 +200,45 @@ class texture {
     std::uint32_t height() const;
 };
 
+struct swapchain_config {
+    // taken when the surface supports it. mailbox and immediate fall back to each
+    // other before fifo, since both are asked for to run uncapped. fifo relaxed
+    // falls back to fifo, which every surface has
+    vk::PresentModeKHR present_mode{vk::PresentModeKHR::eFifo};
+    // clamped to the surface limits, 0 is one more than the minimum
+    std::uint32_t image_count{0};
+};
+
 class swapchain {
     vk::raii::SurfaceKHR _surface{nullptr};
     vk::raii::SwapchainKHR _swapchain{nullptr};
     vk::SurfaceFormatKHR _format{};
     vk::Extent2D _extent{};
     std::vector<vk::raii::ImageView> _image_views{};
+    swapchain_config _config{};
+    vk::PresentModeKHR _present_mode{vk::PresentModeKHR::eFifo};
 
   public:
+    // what a resize replaced, frames submitted before it may still render to the images
+    struct retired {
+        vk::raii::SwapchainKHR swapchain{nullptr};
+        std::vector<vk::raii::ImageView> image_views{};
+    };
+
     swapchain() = default;
-    swapchain(const device& device, const vk::SurfaceKHR& surf, std::uint32_t w, std::uint32_t h);
-    void resize(const device& device, std::uint32_t w, std::uint32_t h);
+    swapchain(const device& device, const vk::SurfaceKHR& surf, std::uint32_t w, std::uint32_t h, swapchain_config config = {});
+    // the new swapchain is created with the current one as oldSwapchain, which is handed back
+    [[nodiscard]] retired resize(const device& device, std::uint32_t w, std::uint32_t h);
 
     const vk::SwapchainKHR& get() const;
 
     vk::SurfaceFormatKHR format() const;
     vk::Extent2D extent() const;
+    // what the surface ended up with, may differ from the config
+    vk::PresentModeKHR present_mode() const;
     std::vector<vk::ImageView> image_views() const;
 
+    // eErrorOutOfDateKHR is returned instead of thrown
     std::pair<vk::Result, std::uint32_t> acquire_next(std::uint64_t timeout, const vk::Semaphore& semaphore = {}, const vk::Fence& fence = {}) const;
 };
 
@@ -0,0 +1,112 @@
+#include "workgroup.hpp"
+
+#include <fmt/core.h>
+
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+
+namespace vulkan {
+
+std::uint32_t workgroup_size::groups_x(std::uint32_t width) const {
+    return (width + x - 1) / x;
+}
+
+std::uint32_t workgroup_size::groups_y(std::uint32_t height) const {
+    return (height + y - 1) / y;
+}
+
+workgroup_specialization::workgroup_specialization(workgroup_size size)
+    : _entries{
+          vk::SpecializationMapEntry{0, offsetof(workgroup_size, x), sizeof(std::uint32_t)},
+          vk::SpecializationMapEntry{1, offsetof(workgroup_size, y), sizeof(std::uint32_t)},
+      },
+      _size(size),
+      _info(_entries.size(), _entries.data(), sizeof(_size), &_size) {}
+
+const vk::SpecializationInfo* workgroup_specialization::info() const {
+    return &_info;
+}
+
+bool workgroup_fits(const device& dev, workgroup_size size, const std::function<std::uint32_t(workgroup_size)>& shared_bytes) {
+    const auto limits = dev.physical().getProperties().limits;
+    if (size.x > limits.maxComputeWorkGroupSize[0] || size.y > limits.maxComputeWorkGroupSize[1]) {
+        return false;
+    }
+    if (std::uint64_t{size.x} * size.y > limits.maxComputeWorkGroupInvocations) {
+        return false;
+    }
+    return !shared_bytes || shared_bytes(size) <= limits.maxComputeSharedMemorySize;
+}
+
+std::vector<workgroup_size> workgroup_candidates(const device& dev, const std::function<std::uint32_t(workgroup_size)>& shared_bytes) {
+    const auto limits = dev.physical().getProperties().limits;
+
+    std::vector<workgroup_size> sizes{};
+    for (std::uint32_t x = 4; x <= limits.maxComputeWorkGroupSize[0]; x *= 2) {
+        for (std::uint32_t y = 1; y <= limits.maxComputeWorkGroupSize[1]; y *= 2) {
+            const workgroup_size size{x, y};
+            // below 32 invocations most devices leave lanes idle
+            if (x * y < 32 || !workgroup_fits(dev, size, shared_bytes)) {
+                continue;
+            }
+            sizes.push_back(size);
+        }
+    }
+
+    return sizes;
+}
+
+namespace {
+
+std::string device_key(const device& dev) {
+    const auto chain = dev.physical().getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+    const auto& props = chain.get<vk::PhysicalDeviceProperties2>().properties;
+    const auto& id = chain.get<vk::PhysicalDeviceIDProperties>();
+
+    std::string key{};
+    for (const auto b : id.deviceUUID) {
+        key += fmt::format("{:02x}", b);
+    }
+    return fmt::format("{} {}", key, props.driverVersion);
+}
+
+} // namespace
+
+workgroup_cache::workgroup_cache(const device& dev, std::filesystem::path path)
+    : _path(std::move(path)), _device_key(device_key(dev)) {
+    std::ifstream in{_path};
+
+    // malformed lines are skipped, a broken cache only costs a retune
+    std::string line{};
+    while (std::getline(in, line)) {
+        std::istringstream fields{line};
+        std::string uuid{}, driver{}, kernel{};
+        workgroup_size size{};
+        if (fields >> uuid >> driver >> kernel >> size.x >> size.y && size.x && size.y) {
+            _entries[uuid + " " + driver + " " + kernel] = size;
+        }
+    }
+}
+
+std::optional<workgroup_size> workgroup_cache::find(std::string_view kernel) const {
+    const auto it = _entries.find(_device_key + " " + std::string{kernel});
+    if (it == _entries.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void workgroup_cache::store(std::string_view kernel, workgroup_size size) {
+    _entries[_device_key + " " + std::string{kernel}] = size;
+
+    std::ofstream out{_path, std::ios::trunc};
+    if (!out) {
+        throw std::runtime_error("failed to write workgroup cache");
+    }
+    for (const auto& [key, s] : _entries) {
+        out << key << ' ' << s.x << ' ' << s.y << '\n';
+    }
+}
+
+} // namespace vulkan
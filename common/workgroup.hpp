@@ -0,0 +1,62 @@
+#pragma once
+
+#include "vulkan.hpp"
+
+#include <array>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace vulkan {
+
+// 2D workgroup size for shaders declaring local_size_x_id = 0 and local_size_y_id = 1
+struct workgroup_size {
+    std::uint32_t x{16};
+    std::uint32_t y{16};
+
+    // ceil-div, the shaders bounds check the partial groups at the edges
+    std::uint32_t groups_x(std::uint32_t width) const;
+    std::uint32_t groups_y(std::uint32_t height) const;
+};
+
+// the info points into the object itself, so it is neither copied nor moved
+class workgroup_specialization {
+    std::array<vk::SpecializationMapEntry, 2> _entries;
+    workgroup_size _size;
+    vk::SpecializationInfo _info;
+
+  public:
+    explicit workgroup_specialization(workgroup_size size);
+    workgroup_specialization(const workgroup_specialization&) = delete;
+    workgroup_specialization& operator=(const workgroup_specialization&) = delete;
+
+    const vk::SpecializationInfo* info() const;
+};
+
+// checks the size and invocation limits, and the shared memory limit when shared_bytes is given
+bool workgroup_fits(const device& dev, workgroup_size size, const std::function<std::uint32_t(workgroup_size)>& shared_bytes = {});
+
+// power of two sizes within the device limits, shared_bytes drops the ones
+// whose shared memory does not fit
+std::vector<workgroup_size> workgroup_candidates(const device& dev, const std::function<std::uint32_t(workgroup_size)>& shared_bytes = {});
+
+// fastest workgroup size per device, driver and kernel, one "uuid driver kernel x y" line each.
+// the device uuid needs an instance of at least vulkan 1.1
+class workgroup_cache {
+    std::filesystem::path _path;
+    std::string _device_key;
+    std::map<std::string, workgroup_size> _entries{};
+
+  public:
+    workgroup_cache(const device& dev, std::filesystem::path path);
+
+    std::optional<workgroup_size> find(std::string_view kernel) const;
+    // rewrites the whole file, entries of other devices are kept
+    void store(std::string_view kernel, workgroup_size size);
+};
+
+} // namespace vulkan
@@ -0,0 +1,278 @@
+#include "vulkan.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include <bench.comp.hpp>
+
+// no layers and no extensions, so it runs on any icd including lavapipe
+constexpr static vk::ApplicationInfo app_info = {
+    "bench",
+    1,
+    "engine",
+    1,
+    VK_API_VERSION_1_0,
+};
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+    std::uint32_t reps{10};
+    const char* output{nullptr};
+};
+
+options parse_options(int argc, char** argv) {
+    options opts{};
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg{argv[i]};
+        if (arg == "--reps" && i + 1 < argc) {
+            opts.reps = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--output" && i + 1 < argc) {
+            opts.output = argv[++i];
+        } else {
+            throw std::runtime_error("usage: bench [--reps n] [--output file.json]");
+        }
+    }
+
+    return opts;
+}
+
+struct result {
+    std::string name;
+    std::uint64_t size{};
+    // bytes moved per sample, zero for pure latency measurements
+    std::uint64_t bytes{};
+    std::vector<double> samples_ms{};
+
+    double median() const {
+        auto s = samples_ms;
+        std::sort(s.begin(), s.end());
+        return s[s.size() / 2];
+    }
+
+    double min() const {
+        return *std::min_element(samples_ms.begin(), samples_ms.end());
+    }
+
+    double max() const {
+        return *std::max_element(samples_ms.begin(), samples_ms.end());
+    }
+};
+
+// driver supplied strings end up in a json string literal
+std::string json_escape(std::string_view text) {
+    std::string out{};
+    out.reserve(text.size());
+    for (const auto c : text) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out += fmt::format("\\u{:04x}", static_cast<unsigned>(c));
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out;
+}
+
+struct bench {
+    vulkan::device _device;
+
+    vk::Queue _queue{nullptr};
+    std::uint32_t _queue_index{};
+
+    vk::raii::CommandPool _command_pool{nullptr};
+    vk::raii::CommandBuffer _command_buffer{nullptr};
+    vk::raii::Fence _fence{nullptr};
+
+    vk::raii::ShaderModule _shader{nullptr};
+    vk::raii::PipelineLayout _pipeline_layout{nullptr};
+    vk::raii::Pipeline _pipeline{nullptr};
+
+    std::uint32_t _reps{};
+    std::vector<result> _results{};
+
+    explicit bench(std::uint32_t reps) : _reps(reps) {
+        _device = vulkan::device{
+            app_info,
+            nullptr,
+            nullptr,
+            nullptr,
+            vk::QueueFlagBits::eCompute,
+            false,
+        };
+
+        // every measurement runs on the compute queue, software icds expose a single family anyway
+        _queue = _device.compute_queue();
+        _queue_index = _device.compute_queue_index();
+
+        _command_pool = _device.make_command_pool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer, _queue_index});
+        vk::CommandBufferAllocateInfo cbai{_command_pool, vk::CommandBufferLevel::ePrimary, 1};
+        _command_buffer = std::move(_device.make_command_buffers(cbai).front());
+        _fence = _device.make_fence({});
+
+        _shader = _device.make_shader_module({{}, bench_comp::size, bench_comp::code});
+        _pipeline_layout = _device.make_pipeline_layout({});
+        _pipeline = make_pipeline();
+    }
+
+    vk::raii::Pipeline make_pipeline() const {
+        vk::PipelineShaderStageCreateInfo pssci{{}, vk::ShaderStageFlagBits::eCompute, *_shader, "main"};
+        vk::ComputePipelineCreateInfo cpci{{}, pssci, *_pipeline_layout};
+        return _device.make_pipeline(cpci);
+    }
+
+    // records, submits and waits, the sample spans the whole round-trip
+    double submit(const std::function<void(const vk::CommandBuffer&)>& record) {
+        const auto start = clock_type::now();
+
+        _command_buffer.reset();
+        _command_buffer.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        record(*_command_buffer);
+        _command_buffer.end();
+
+        _queue.submit(vk::SubmitInfo{{}, {}, *_command_buffer}, *_fence);
+        while (vk::Result::eTimeout == _device.logical().waitForFences(*_fence, vk::True, -1)) {
+        }
+        _device.logical().resetFences(*_fence);
+
+        return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    }
+
+    // one warm-up run which is not recorded
+    void measure(std::string name, std::uint64_t size, std::uint64_t bytes, const std::function<double()>& sample) {
+        sample();
+
+        auto& r = _results.emplace_back(result{std::move(name), size, bytes});
+        for (std::uint32_t i = 0; i < _reps; ++i) {
+            r.samples_ms.push_back(sample());
+        }
+
+        fmt::print(stderr, "{:<16} {:>10} median {:8.3f}ms\n", r.name, r.size, r.median());
+    }
+
+    void bandwidth() {
+        for (const vk::DeviceSize size : {64u << 10, 1u << 20, 16u << 20, 64u << 20}) {
+            const auto usage = vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst;
+            vulkan::host_buffer upload{_device, size, usage, vulkan::memory_usage::upload};
+            vulkan::host_buffer readback{_device, size, usage, vulkan::memory_usage::readback};
+            vulkan::device_buffer local{_device, size, usage};
+
+            measure("upload", size, size, [&] {
+                return submit([&](const vk::CommandBuffer& cb) { vulkan::utils::copy_buffers(cb, upload.buf(), local.buf(), size); });
+            });
+
+            measure("readback", size, size, [&] {
+                return submit([&](const vk::CommandBuffer& cb) { vulkan::utils::copy_buffers(cb, local.buf(), readback.buf(), size); });
+            });
+        }
+    }
+
+    void buffer_to_image() {
+        for (const std::uint32_t dim : {256u, 1024u, 2048u}) {
+            const vk::DeviceSize size = dim * dim * 4;
+            vulkan::host_buffer upload{_device, size, vk::BufferUsageFlagBits::eTransferSrc, vulkan::memory_usage::upload};
+            vulkan::texture image{_device, dim, dim, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled};
+
+            measure("buffer_to_image", dim, size, [&] {
+                return submit([&](const vk::CommandBuffer& cb) {
+                    vulkan::utils::copy_buffer_to_image(cb, upload.buf(), image.image(), image.extent(), vk::ImageLayout::eShaderReadOnlyOptimal);
+                });
+            });
+        }
+    }
+
+    void dispatch() {
+        measure("empty_dispatch", 1, 0, [&] {
+            return submit([&](const vk::CommandBuffer& cb) {
+                cb.bindPipeline(vk::PipelineBindPoint::eCompute, *_pipeline);
+                cb.dispatch(1, 1, 1);
+            });
+        });
+    }
+
+    void round_trip() {
+        measure("submit_fence", 0, 0, [&] {
+            return submit([](const vk::CommandBuffer&) {});
+        });
+    }
+
+    void pipeline_creation() {
+        measure("pipeline_create", 1, 0, [&] {
+            const auto start = clock_type::now();
+            const auto pipeline = make_pipeline();
+            return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+        });
+    }
+
+    std::string json() const {
+        const auto props = _device.physical().getProperties();
+
+        std::string out = fmt::format("{{\n  \"device\": \"{}\",\n  \"device_type\": \"{}\",\n  \"api_version\": \"{}.{}.{}\",\n  \"driver_version\": {},\n  \"reps\": {},\n  \"results\": [\n",
+                                      json_escape(props.deviceName.data()),
+                                      vk::to_string(props.deviceType),
+                                      VK_VERSION_MAJOR(props.apiVersion),
+                                      VK_VERSION_MINOR(props.apiVersion),
+                                      VK_VERSION_PATCH(props.apiVersion),
+                                      props.driverVersion,
+                                      _reps);
+
+        for (std::size_t i = 0; i < _results.size(); ++i) {
+            const auto& r = _results[i];
+            const auto median = r.median();
+            const auto gbps = r.bytes && median > 0 ? r.bytes / (median * 1e6) : 0.0;
+            out += fmt::format("    {{\"name\": \"{}\", \"size\": {}, \"median_ms\": {:.6f}, \"min_ms\": {:.6f}, \"max_ms\": {:.6f}, \"gb_per_s\": {:.3f}}}{}\n",
+                               r.name, r.size, median, r.min(), r.max(), gbps, i + 1 < _results.size() ? "," : "");
+        }
+
+        out += "  ]\n}\n";
+        return out;
+    }
+};
+
+int main(int argc, char** argv) {
+    try {
+        const auto opts = parse_options(argc, argv);
+
+        bench b{opts.reps};
+        b.bandwidth();
+        b.buffer_to_image();
+        b.dispatch();
+        b.round_trip();
+        b.pipeline_creation();
+
+        const auto out = b.json();
+        if (opts.output) {
+            auto* f = std::fopen(opts.output, "w");
+            if (!f) {
+                throw std::runtime_error("failed to open output file");
+            }
+            std::fputs(out.c_str(), f);
+            std::fclose(f);
+        } else {
+            fmt::print("{}", out);
+        }
+
+        b._device.logical().waitIdle();
+
+    } catch (const std::exception& ex) {
+        fmt::print(stderr, "error: {}\n", ex.what());
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,4 +1,8 @@
 #include "application.hpp"
+#include "transfer.hpp"
+#include "workgroup.hpp"
+
+#include <algorithm>
 
 #include <fmt/core.h>
 
@@ -10,6 +14,8 @@
 #include <stb_image.h>
 
 #include <compute.comp.hpp>
+#include <compute_tiled.comp.hpp>
+#include <compute_tiled_fp16.comp.hpp>
 #include <compute.frag.hpp>
 #include <compute.vert.hpp>
 
@@ -30,7 +36,9 @@ struct vertex {
 };
 
 struct compute : public common::application<compute> {
-    static constexpr auto local_size = 32;
+    // the only place the sizes are set, the shaders get them as specialization constants
+    static constexpr vulkan::workgroup_size naive_workgroup{32, 32};
+    static constexpr vulkan::workgroup_size tiled_workgroup{16, 16};
 
     vk::raii::Pipeline _pipeline{nullptr};
     vk::raii::PipelineLayout _pipeline_layout{nullptr};
@@ -38,32 +46,69 @@ struct compute : public common::application<compute> {
     vulkan::device_buffer _verticies_buffer;
     vulkan::device_buffer _indices_buffer;
     vulkan::texture _input_texture;
-    vulkan::texture _output_texture;
+    // one per frame in flight, the dispatch of the next frame writes its own image
+    // while the draw of this frame still samples the previous one
+    std::vector<vulkan::texture> _output_textures;
 
+    // the sets of both passes come from the frame's arena and point at the frame's output image
     vk::raii::DescriptorSetLayout _descriptor_layout{nullptr};
-    vk::raii::DescriptorPool _descriptor_pool{nullptr};
-    vk::raii::DescriptorSet _descriptor_set{nullptr};
-
-    vk::raii::Semaphore _graphic_semaphore{nullptr};
 
     std::string _device_name;
     std::string _queue_info;
 
     struct {
         vk::Queue queue{nullptr};
+        std::uint32_t family{};
         vk::raii::DescriptorSetLayout descriptor_layout{nullptr};
-        vk::raii::DescriptorSet descriptor_set{nullptr};
         vk::raii::Pipeline pipeline{nullptr};
+        vk::raii::Pipeline tiled_pipeline{nullptr};
+        // the tiled kernel in half precision, only built when the device has float16
+        vk::raii::Pipeline half_pipeline{nullptr};
+        bool tiled{true};
+        bool half{false};
+        // waits for the previous draw like a single output image would, to compare frame times
+        bool serial{false};
+        // per output image, released by the draw and not yet acquired back by compute
+        std::vector<bool> with_graphics;
         vk::raii::PipelineLayout pipeline_layout{nullptr};
-        vk::raii::Semaphore semaphore{nullptr};
+        // each dispatch signals the next value, the frame's draw waits for it
+        vulkan::timeline_queue timeline;
         vk::raii::CommandPool command_pool{nullptr};
-        vk::raii::CommandBuffer command_buffer{nullptr};
+        // one per frame in flight, free again once the frame's graphic value is reached
+        vk::raii::CommandBuffers command_buffers{nullptr};
+        vulkan::gpu_profiler profiler;
     } _compute;
 
-    compute() : common::application<compute>({"compute", 1, "engine", 1, VK_API_VERSION_1_0}, 800, 600) {
-        make_vertex_buffer();
-        make_indices_buffer();
-        make_input_image();
+    // the fp16 kernel is offered when the device has float16
+    static common::application_config with_float16(common::application_config config) {
+        config.features.float16 = true;
+        return config;
+    }
+
+    compute(bool batched, bool serial, const common::application_config& config)
+        : common::application<compute>({"compute", 1, "engine", 1, VK_API_VERSION_1_1}, 800, 600, with_float16(config)) {
+        _compute.queue = _device.compute_queue();
+        _compute.family = _device.compute_queue_index();
+        _compute.serial = serial;
+
+        const auto start = std::chrono::steady_clock::now();
+        {
+            vulkan::upload_batch batch{_device, _ring};
+            make_vertex_buffer(batch);
+            if (!batched) {
+                batch.submit().wait();
+            }
+            make_indices_buffer(batch);
+            const auto graphic_uploads = batch.submit();
+
+            // the images start out owned by the compute family, the first dispatch needs no acquire
+            vulkan::upload_batch compute_batch{_device, _ring, _compute.family};
+            make_images(compute_batch);
+            compute_batch.submit().wait();
+            graphic_uploads.wait();
+        }
+        const auto dur = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        fmt::print("{} uploads took {:.2f}ms\n", batched ? "batched" : "unbatched", dur);
 
         get_device_info();
 
@@ -74,23 +119,6 @@ struct compute : public common::application<compute> {
         vk::DescriptorSetLayoutCreateInfo dslci{{}, bindings};
         _descriptor_layout = _device.make_descriptor_set_layout(dslci);
 
-        vk::DescriptorPoolSize sizes[] = {
-            {vk::DescriptorType::eCombinedImageSampler, 1},
-            {vk::DescriptorType::eStorageImage, 2},
-        };
-
-        vk::DescriptorPoolCreateInfo dpci{vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 2, sizes};
-        _descriptor_pool = _device.make_descriptor_pool(dpci);
-
-        vk::DescriptorSetAllocateInfo dsai{_descriptor_pool, *_descriptor_layout};
-        _descriptor_set = std::move(_device.make_descriptor_sets(dsai).front());
-
-        vk::DescriptorImageInfo dii{_output_texture.sampler(), _output_texture.view(), vk::ImageLayout::eGeneral};
-        vk::WriteDescriptorSet wdss[] = {
-            {_descriptor_set, 0, 0, vk::DescriptorType::eCombinedImageSampler, dii},
-        };
-        _device.logical().updateDescriptorSets(wdss, nullptr);
-
         const auto vert_shader = _device.make_shader_module({{}, compute_vert::size, compute_vert::code});
         const auto frag_shader = _device.make_shader_module({{}, compute_frag::size, compute_frag::code});
 
@@ -112,11 +140,6 @@ struct compute : public common::application<compute> {
             .setRenderPass(_render_pass);
         _pipeline = _device.make_pipeline(pci);
 
-        _graphic_semaphore = _device.make_semaphore({});
-        vk::SubmitInfo si{{}, {}, {}, *_graphic_semaphore};
-        _graphic_queue.submit(si);
-        _graphic_queue.waitIdle();
-
         make_compute_context();
     }
 
@@ -129,12 +152,14 @@ struct compute : public common::application<compute> {
             _device_name = fmt::format("gpu: {} api: {}.{}.{}", props.deviceName.data(), major, minor, patch);
         }
         {
-            const auto props = _device.physical().getQueueFamilyProperties()[_graphic_queue_index];
-            _queue_info = fmt::format("queue: {}", vk::to_string(props.queueFlags));
+            const auto props = _device.physical().getQueueFamilyProperties();
+            _queue_info = fmt::format("graphic family {}: {}\ncompute family {}: {}",
+                                      _graphic_queue_index, vk::to_string(props[_graphic_queue_index].queueFlags),
+                                      _compute.family, vk::to_string(props[_compute.family].queueFlags));
         }
     }
 
-    void make_vertex_buffer() {
+    void make_vertex_buffer(vulkan::upload_batch& batch) {
         std::array<vertex, 4> verticies = {{
             {{-1.0, +1.0}, {0.0, 1.0}},
             {{+1.0, +1.0}, {1.0, 1.0}},
@@ -143,36 +168,29 @@ struct compute : public common::application<compute> {
         }};
 
         constexpr auto size = sizeof(vertex) * verticies.size();
-        vulkan::host_buffer staging{_device, size, vk::BufferUsageFlagBits::eTransferSrc};
-        staging.copy(verticies.data(), size);
-
         _verticies_buffer = {
             _device,
             size,
             vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
         };
 
-        vk::ClearValue clear_value{vk::ClearColorValue{0.5f, 0.5f, 0.5f, 1.0f}};
-        _device.copy_buffers(staging.buf(), _verticies_buffer.buf(), size);
+        batch.upload(_verticies_buffer, verticies.data(), size);
     }
 
-    void make_indices_buffer() {
+    void make_indices_buffer(vulkan::upload_batch& batch) {
         std::array<std::uint32_t, 6> indicies = {0, 1, 2, 2, 3, 0};
 
         constexpr auto size = sizeof(std::uint32_t) * indicies.size();
-        vulkan::host_buffer staging{_device, size, vk::BufferUsageFlagBits::eTransferSrc};
-        staging.copy(indicies.data(), size);
-
         _indices_buffer = {
             _device,
             size,
             vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
         };
 
-        _device.copy_buffers(staging.buf(), _indices_buffer.buf(), size);
+        batch.upload(_indices_buffer, indicies.data(), size);
     }
 
-    void make_input_image() {
+    void make_images(vulkan::upload_batch& batch) {
         int w{}, h{}, c{}, wc{4};
         auto data = stbi_load("textures/vulkan.png", &w, &h, &c, wc);
         if (!data) {
@@ -182,14 +200,6 @@ struct compute : public common::application<compute> {
         std::uint32_t width = w;
         std::uint32_t height = h;
 
-        const vk::DeviceSize size = w * h * wc;
-        vulkan::host_buffer staging{
-            _device,
-            size,
-            vk::BufferUsageFlagBits::eTransferSrc,
-        };
-        staging.copy(data, size);
-
         _input_texture = {
             _device,
             width,
@@ -197,22 +207,19 @@ struct compute : public common::application<compute> {
             vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst,
         };
 
-        _device.copy_buffer_to_image(staging.buf(), _input_texture.image(), _input_texture.extent(), vk::ImageLayout::eShaderReadOnlyOptimal);
-
-        _device.image_transition(_input_texture.image(), vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eGeneral);
-
-        _output_texture = {
-            _device,
-            width,
-            height,
-            vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
-        };
+        batch.upload(_input_texture, data, vk::ImageLayout::eGeneral);
 
-        _device.image_transition(_output_texture.image(), vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+        for (std::uint32_t f = 0; f < _frames_in_flight; ++f) {
+            auto& output = _output_textures.emplace_back(
+                _device,
+                width,
+                height,
+                vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage);
+            batch.image_transition(output.image(), vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+        }
     }
 
     void make_compute_context() {
-        _compute.queue = _device.compute_queue();
         vk::DescriptorSetLayoutBinding bindings[] = {
             {0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute},
             {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute},
@@ -224,78 +231,104 @@ struct compute : public common::application<compute> {
         vk::PipelineLayoutCreateInfo plci{{}, *_compute.descriptor_layout};
         _compute.pipeline_layout = _device.make_pipeline_layout(plci);
 
-        vk::DescriptorSetAllocateInfo dsai{_descriptor_pool, *_compute.descriptor_layout};
-        _compute.descriptor_set = std::move(_device.make_descriptor_sets(dsai).front());
-
-        vk::DescriptorImageInfo input_dii{_input_texture.sampler(), _input_texture.view(), vk::ImageLayout::eGeneral};
-        vk::DescriptorImageInfo output_dii{_output_texture.sampler(), _output_texture.view(), vk::ImageLayout::eGeneral};
-        vk::WriteDescriptorSet wds[] = {
-            vk::WriteDescriptorSet{_compute.descriptor_set, 0, 0, vk::DescriptorType::eStorageImage, input_dii},
-            vk::WriteDescriptorSet{_compute.descriptor_set, 1, 0, vk::DescriptorType::eStorageImage, output_dii},
-        };
-
-        _device.logical().updateDescriptorSets(wds, nullptr);
+        _compute.with_graphics.assign(_frames_in_flight, false);
 
         const auto comp_shader = _device.make_shader_module({{}, compute_comp::size, compute_comp::code});
+        const vulkan::workgroup_specialization naive_specialization{naive_workgroup};
         vk::PipelineShaderStageCreateInfo pssci{
-            vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eCompute, comp_shader, "main"},
+            vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eCompute, comp_shader, "main", naive_specialization.info()},
         };
         vk::ComputePipelineCreateInfo cpci{{}, pssci, _compute.pipeline_layout};
         _compute.pipeline = _device.make_pipeline(cpci);
 
-        _compute.command_pool = _device.make_command_pool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer, _graphic_queue_index});
-        vk::CommandBufferAllocateInfo cbai{_compute.command_pool, vk::CommandBufferLevel::ePrimary, 1};
-        _compute.command_buffer = std::move(_device.make_command_buffers(cbai).front());
+        const auto tiled_shader = _device.make_shader_module({{}, compute_tiled_comp::size, compute_tiled_comp::code});
+        const vulkan::workgroup_specialization tiled_specialization{tiled_workgroup};
+        cpci.stage.module = *tiled_shader;
+        cpci.stage.pSpecializationInfo = tiled_specialization.info();
+        _compute.tiled_pipeline = _device.make_pipeline(cpci);
+
+        if (_device.features().float16) {
+            const auto half_shader = _device.make_shader_module({{}, compute_tiled_fp16_comp::size, compute_tiled_fp16_comp::code});
+            cpci.stage.module = *half_shader;
+            _compute.half_pipeline = _device.make_pipeline(cpci);
+            _compute.half = true;
+        }
+
+        _compute.command_pool = _device.make_command_pool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer, _compute.family});
+        vk::CommandBufferAllocateInfo cbai{_compute.command_pool, vk::CommandBufferLevel::ePrimary, _frames_in_flight};
+        _compute.command_buffers = _device.make_command_buffers(cbai);
+        _compute.profiler = vulkan::gpu_profiler{_device, _compute.family, _frames_in_flight};
 
-        _compute.semaphore = _device.make_semaphore({});
+        _compute.timeline = vulkan::timeline_queue{_device, _compute.queue};
     }
 
+    // the frame's graphic value was reached in acquire() and that submit waited for this
+    // slot's dispatch, so its command buffer and queries are free without a queue wait
     void record_compute() {
-        _compute.queue.waitIdle();
+        const auto& cb = _compute.command_buffers[_current_frame];
+        _compute.profiler.resolve(_current_frame);
 
-        _compute.command_buffer.begin({});
-        _compute.command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, _compute.pipeline);
-        _compute.command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _compute.pipeline_layout, 0, *_compute.descriptor_set, nullptr);
-        _compute.command_buffer.dispatch(_input_texture.extent().width / local_size, _input_texture.extent().height / local_size, 1);
-        _compute.command_buffer.end();
+        const auto& output = _output_textures[_current_frame];
+        const auto transfers = _compute.family != _graphic_queue_index;
 
-        vk::PipelineStageFlags wait_flags{vk::PipelineStageFlagBits::eComputeShader};
-
-        vk::SubmitInfo info{
-            *_graphic_semaphore,
-            wait_flags,
-            *_compute.command_buffer,
-            *_compute.semaphore,
+        // pool resets are per frame, so the set stays valid until this dispatch is done
+        const auto set = _frames[_current_frame].context.allocate_descriptor_set(*_compute.descriptor_layout);
+        vk::DescriptorImageInfo input_dii{_input_texture.sampler(), _input_texture.view(), vk::ImageLayout::eGeneral};
+        vk::DescriptorImageInfo output_dii{output.sampler(), output.view(), vk::ImageLayout::eGeneral};
+        vk::WriteDescriptorSet wds[] = {
+            {set, 0, 0, vk::DescriptorType::eStorageImage, input_dii},
+            {set, 1, 0, vk::DescriptorType::eStorageImage, output_dii},
         };
-        _compute.queue.submit(info);
+        _device.logical().updateDescriptorSets(wds, nullptr);
+
+        cb.begin({});
+        _compute.profiler.reset(*cb, _current_frame);
+        if (transfers && _compute.with_graphics[_current_frame]) {
+            vulkan::utils::acquire_ownership(*cb, output.image(), _graphic_queue_index, _compute.family, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+            _compute.with_graphics[_current_frame] = false;
+        }
+        {
+            const auto [w, h, d] = _input_texture.extent();
+            const auto half = _compute.tiled && _compute.half;
+            const auto scope = _compute.profiler.scoped(*cb, half ? "sharpen tiled fp16" : _compute.tiled ? "sharpen tiled" : "sharpen naive");
+            cb.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _compute.pipeline_layout, 0, set, nullptr);
+            const auto& workgroup = _compute.tiled ? tiled_workgroup : naive_workgroup;
+            const auto& pipeline = half ? _compute.half_pipeline : _compute.tiled ? _compute.tiled_pipeline : _compute.pipeline;
+            cb.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+            cb.dispatch(workgroup.groups_x(w), workgroup.groups_y(h), 1);
+        }
+        if (transfers) {
+            vulkan::utils::release_ownership(*cb, output.image(), _compute.family, _graphic_queue_index, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+        }
+        cb.end();
+
+        // only the draw that last sampled this frame's image has to be done, acquire() already
+        // waited for it on the cpu. the wait pairs the release of that draw with the acquire above
+        const auto after = _compute.serial ? _graphic_timeline.last() : _graphic_timeline.at(_frames[_current_frame].submitted);
+        const vulkan::timeline_queue::wait_info wait{after, vk::PipelineStageFlagBits::eAllCommands};
+        _compute.timeline.submit(*cb, wait);
     }
 
     void present(std::uint32_t index) {
-        const auto& [cb, image_available_semaphore, render_finished_semaphore, fence] = _frames[_current_frame];
-        vk::PipelineStageFlags wait_flags[] = {vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eColorAttachmentOutput};
-        vk::Semaphore wait_semaphores[] = {_compute.semaphore, image_available_semaphore};
-        vk::Semaphore signal_semaphores[] = {_graphic_semaphore, render_finished_semaphore};
-        vk::SubmitInfo submit{
-            wait_semaphores,
-            wait_flags,
-            *cb,
-            signal_semaphores,
+        auto& [context, image_available_semaphore, render_finished_semaphore, submitted] = _frames[_current_frame];
+        const vulkan::timeline_queue::wait_info waits[] = {
+            // all commands so the ownership acquire at the top of the draw is covered too
+            {_compute.timeline.last(), vk::PipelineStageFlagBits::eAllCommands},
+            {{*image_available_semaphore}, vk::PipelineStageFlagBits::eColorAttachmentOutput},
         };
-        _graphic_queue.submit(submit, fence);
-
-        vk::PresentInfoKHR present_info{*render_finished_semaphore, _swapchain.get(), index};
-        auto rv = _present_queue.presentKHR(present_info);
-        if (rv != vk::Result::eSuccess) {
-            fmt::print("present err: {}\n", vk::to_string(rv));
-        }
+        const vulkan::timeline_point render_finished{*render_finished_semaphore};
+        submitted = _graphic_timeline.submit(*context.command_buffer(), waits, render_finished).value;
+        _frame_stats.mark(common::frame_stats::phase::submit);
 
-        _current_frame = (_current_frame + 1) % frames_in_flight;
+        present_image(index);
+        _current_frame = (_current_frame + 1) % _frames_in_flight;
     }
 
     void record(std::uint32_t i) {
         record_compute();
 
-        const auto& cb = _frames[_current_frame].command_buffer;
+        auto& context = _frames[_current_frame].context;
+        const auto& cb = context.command_buffer();
         const auto time = current_time();
 
         vk::ClearValue clear_values[] = {
@@ -305,11 +338,26 @@ struct compute : public common::application<compute> {
         vk::RenderPassBeginInfo rpbi{_render_pass, _framebuffers[i], {{0, 0}, _swapchain.extent()}, clear_values};
         vk::Viewport viewport{0.0f, 0.0f, (float)_swapchain.extent().width, (float)_swapchain.extent().height, 0.0f, 1.0f};
 
-        cb.reset();
+        const auto& output = _output_textures[_current_frame];
+        const auto transfers = _compute.family != _graphic_queue_index;
+
+        const auto set = context.allocate_descriptor_set(*_descriptor_layout);
+        vk::DescriptorImageInfo dii{output.sampler(), output.view(), vk::ImageLayout::eGeneral};
+        vk::WriteDescriptorSet wdss[] = {
+            {set, 0, 0, vk::DescriptorType::eCombinedImageSampler, dii},
+        };
+        _device.logical().updateDescriptorSets(wdss, nullptr);
+
         cb.begin({});
+        _profiler.reset(*cb, _current_frame);
+        if (transfers) {
+            vulkan::utils::acquire_ownership(*cb, output.image(), _compute.family, _graphic_queue_index, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+        }
+
+        const auto pass = _profiler.begin(*cb, "render pass");
         cb.beginRenderPass(rpbi, vk::SubpassContents::eInline);
         cb.bindPipeline(vk::PipelineBindPoint::eGraphics, _pipeline);
-        cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipeline_layout, 0, {_descriptor_set}, nullptr);
+        cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipeline_layout, 0, set, nullptr);
         cb.bindVertexBuffers(0, _verticies_buffer.buf(), {0});
         cb.bindIndexBuffer(_indices_buffer.buf(), 0, vk::IndexType::eUint32);
         cb.setViewport(0, viewport);
@@ -319,16 +367,36 @@ struct compute : public common::application<compute> {
         _overlay.begin();
         _overlay.text(_device_name);
         _overlay.text(_queue_info);
+        _overlay.text(_compute.serial ? "compute: after the previous draw" : fmt::format("compute: overlapped, {} output images", _output_textures.size()));
+        if (_overlay.button(_compute.tiled ? "kernel: tiled" : "kernel: naive")) {
+            _compute.tiled = !_compute.tiled;
+        }
+        if (_compute.tiled && *_compute.half_pipeline && _overlay.button(_compute.half ? "precision: fp16" : "precision: fp32")) {
+            _compute.half = !_compute.half;
+        }
+        overlay_gpu_times();
+        overlay_frame_times();
+        for (const auto& r : _compute.profiler.results()) {
+            _overlay.text(fmt::format("{}: {:.3f}ms", r.name, r.ms));
+        }
         _overlay.draw(*cb);
 
         cb.endRenderPass();
+        _profiler.end(*cb, pass);
+        if (transfers) {
+            vulkan::utils::release_ownership(*cb, output.image(), _graphic_queue_index, _compute.family, vk::ImageLayout::eGeneral, vk::ImageLayout::eGeneral);
+            _compute.with_graphics[_current_frame] = true;
+        }
         cb.end();
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
     try {
-        compute text{};
+        const auto has = [argc, argv](std::string_view flag) {
+            return std::any_of(argv + 1, argv + argc, [flag](const char* arg) { return std::string_view{arg} == flag; });
+        };
+        compute text{!has("--unbatched"), has("--serial-compute"), common::application_config::parse(argc, argv)};
 
         text.run();
 
@@ -0,0 +1,229 @@
+#include "convolution.hpp"
+#include "transfer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+#include <convolve.comp.hpp>
+#include <convolve_cols.comp.hpp>
+#include <convolve_rows.comp.hpp>
+
+namespace {
+
+std::vector<float> binomial(std::uint32_t n) {
+    std::vector<float> row{1.0f};
+    for (std::uint32_t i = 1; i < n; ++i) {
+        std::vector<float> next(row.size() + 1, 0.0f);
+        for (std::size_t j = 0; j < row.size(); ++j) {
+            next[j] += row[j];
+            next[j + 1] += row[j];
+        }
+        row = std::move(next);
+    }
+    return row;
+}
+
+std::uint32_t preset_size(std::string_view spec, std::string_view prefix) {
+    const auto n = static_cast<std::uint32_t>(std::stoul(std::string{spec.substr(prefix.size())}));
+    if (n % 2 == 0 || n < 3 || n > filter::max_size) {
+        throw std::runtime_error("filter size has to be odd and between 3 and 15");
+    }
+    return n;
+}
+
+} // namespace
+
+filter filter::parse(std::string_view spec) {
+    if (spec == "sharpen") {
+        return {3, {-1, -1, -1, -1, 9, -1, -1, -1, -1}};
+    }
+    if (spec == "edge") {
+        return {3, {-1, -1, -1, -1, 8, -1, -1, -1, -1}};
+    }
+    if (spec == "emboss") {
+        return {3, {-2, -1, 0, -1, 1, 1, 0, 1, 2}};
+    }
+    if (spec.substr(0, 3) == "box") {
+        const auto n = preset_size(spec, "box");
+        return {n, std::vector<float>(n * n, 1.0f), 1.0f / (n * n)};
+    }
+    if (spec.substr(0, 7) == "levels:") {
+        // maps [black, white] to [0, 1] as a 1x1 filter
+        const auto rest = spec.substr(7);
+        const auto colon = rest.find(':');
+        if (colon == std::string_view::npos) {
+            throw std::runtime_error("levels needs a black and a white point");
+        }
+        const auto black = std::stof(std::string{rest.substr(0, colon)});
+        const auto white = std::stof(std::string{rest.substr(colon + 1)});
+        if (white <= black) {
+            throw std::runtime_error("levels needs a white point above the black point");
+        }
+        return {1, {1.0f}, 1.0f / (white - black), -black / (white - black)};
+    }
+    if (spec.substr(0, 8) == "gaussian") {
+        const auto n = preset_size(spec, "gaussian");
+        const auto b = binomial(n);
+        filter f{n};
+        float total{};
+        for (const auto y : b) {
+            for (const auto x : b) {
+                f.weights.push_back(x * y);
+                total += x * y;
+            }
+        }
+        f.scale = 1.0f / total;
+        return f;
+    }
+
+    // explicit weights with an optional denominator and bias
+    filter f{};
+    const auto weights = spec.substr(0, spec.find(':'));
+    std::size_t begin = 0;
+    while (begin <= weights.size()) {
+        const auto end = std::min(weights.find(',', begin), weights.size());
+        f.weights.push_back(std::stof(std::string{weights.substr(begin, end - begin)}));
+        begin = end + 1;
+    }
+
+    if (const auto colon = spec.find(':'); colon != std::string_view::npos) {
+        const auto rest = spec.substr(colon + 1);
+        const auto second = rest.find(':');
+        const auto denominator = std::stof(std::string{rest.substr(0, second)});
+        if (denominator == 0.0f) {
+            throw std::runtime_error("filter denominator must not be zero");
+        }
+        f.scale = 1.0f / denominator;
+        if (second != std::string_view::npos) {
+            f.bias = std::stof(std::string{rest.substr(second + 1)});
+        }
+    }
+
+    f.size = static_cast<std::uint32_t>(std::lround(std::sqrt(f.weights.size())));
+    if (f.size * f.size != f.weights.size() || f.size % 2 == 0 || f.size > max_size) {
+        throw std::runtime_error("filter needs an odd square number of weights, at most 15x15");
+    }
+
+    return f;
+}
+
+std::int32_t filter::radius() const {
+    return static_cast<std::int32_t>(size / 2);
+}
+
+std::optional<std::pair<std::vector<float>, std::vector<float>>> filter::separate() const {
+    // a point operation gains nothing from a second pass
+    if (size < 3) {
+        return std::nullopt;
+    }
+
+    // the largest weight is the pivot, its row and column span the kernel if it has rank one
+    const auto pivot = std::distance(weights.begin(), std::max_element(weights.begin(), weights.end(), [](float a, float b) {
+                                         return std::abs(a) < std::abs(b);
+                                     }));
+    const auto p = pivot / size;
+    const auto q = pivot % size;
+    const auto max = std::abs(weights[pivot]);
+    if (max == 0.0f) {
+        return std::nullopt;
+    }
+
+    std::vector<float> row(weights.begin() + p * size, weights.begin() + (p + 1) * size);
+    std::vector<float> col(size);
+    for (std::uint32_t i = 0; i < size; ++i) {
+        col[i] = weights[i * size + q] / weights[pivot];
+    }
+
+    const auto tolerance = 1e-5f * max;
+    for (std::uint32_t y = 0; y < size; ++y) {
+        for (std::uint32_t x = 0; x < size; ++x) {
+            if (std::abs(weights[y * size + x] - col[y] * row[x]) > tolerance) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    return std::make_pair(std::move(row), std::move(col));
+}
+
+convolution::convolution(const vulkan::device& dev, std::uint32_t queue_family, const vk::PipelineLayout& layout, const filter& f, bool allow_separable, vulkan::workgroup_size workgroup)
+    : _filter(f) {
+    // the weights buffer keeps the row vector followed by the column vector on the separable path
+    auto weights = _filter.weights;
+    if (const auto split = allow_separable ? _filter.separate() : std::nullopt) {
+        _separable = true;
+        weights = split->first;
+        weights.insert(weights.end(), split->second.begin(), split->second.end());
+    }
+
+    const vk::DeviceSize size = weights.size() * sizeof(float);
+    _weights = {dev, size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst};
+    vulkan::upload_batch{dev, queue_family}.upload(_weights, weights.data(), size).submit().wait();
+
+    set_workgroup(dev, layout, workgroup);
+}
+
+void convolution::set_workgroup(const vulkan::device& dev, const vk::PipelineLayout& layout, vulkan::workgroup_size workgroup) {
+    _workgroup = workgroup;
+
+    const vulkan::workgroup_specialization specialization{_workgroup};
+    const auto make_pipeline = [&](const std::uint32_t* code, std::size_t code_size) {
+        const auto shader = dev.make_shader_module({{}, code_size, code});
+        vk::PipelineShaderStageCreateInfo pssci{{}, vk::ShaderStageFlagBits::eCompute, *shader, "main", specialization.info()};
+        return dev.make_pipeline(vk::ComputePipelineCreateInfo{{}, pssci, layout});
+    };
+
+    if (_separable) {
+        _rows = make_pipeline(convolve_rows_comp::code, convolve_rows_comp::size);
+        _cols = make_pipeline(convolve_cols_comp::code, convolve_cols_comp::size);
+    } else {
+        _full = make_pipeline(convolve_comp::code, convolve_comp::size);
+    }
+}
+
+std::uint32_t convolution::shared_bytes(vulkan::workgroup_size workgroup) {
+    // vec3 is padded to 16 bytes in shared memory on most devices
+    const auto halo = 2 * (filter::max_size / 2);
+    return (workgroup.x + halo) * (workgroup.y + halo) * 16;
+}
+
+bool convolution::separable() const {
+    return _separable;
+}
+
+std::int32_t convolution::radius() const {
+    return _filter.radius();
+}
+
+const vk::Buffer& convolution::weights() const {
+    return _weights.buf();
+}
+
+vk::DeviceSize convolution::intermediate_size(vk::Extent3D extent) const {
+    return _separable ? vk::DeviceSize{extent.width} * extent.height * 4 * sizeof(float) : 0;
+}
+
+void convolution::record(const vk::CommandBuffer& cb, const vk::PipelineLayout& layout, vk::Extent3D extent) const {
+    const push_constants pc{_filter.radius(), _filter.scale, _filter.bias};
+    cb.pushConstants(layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(pc), &pc);
+
+    const auto groups_x = _workgroup.groups_x(extent.width);
+    const auto groups_y = _workgroup.groups_y(extent.height);
+
+    if (!_separable) {
+        cb.bindPipeline(vk::PipelineBindPoint::eCompute, *_full);
+        cb.dispatch(groups_x, groups_y, 1);
+        return;
+    }
+
+    cb.bindPipeline(vk::PipelineBindPoint::eCompute, *_rows);
+    cb.dispatch(groups_x, groups_y, 1);
+
+    vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead};
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+
+    cb.bindPipeline(vk::PipelineBindPoint::eCompute, *_cols);
+    cb.dispatch(groups_x, groups_y, 1);
+}
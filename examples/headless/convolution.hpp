@@ -0,0 +1,71 @@
+#pragma once
+
+#include "vulkan.hpp"
+#include "workgroup.hpp"
+
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// square kernel with an odd size, weights are row-major and applied without flipping.
+// the result is sum * scale + bias, clamped to [0, 1]
+struct filter {
+    static constexpr std::uint32_t max_size = 15;
+
+    std::uint32_t size{};
+    std::vector<float> weights{};
+    float scale{1.0f};
+    float bias{0.0f};
+
+    // a preset (sharpen, edge, emboss, boxN, gaussianN, levels:black:white) or
+    // "w0,w1,...,wN*N[:denominator[:bias]]"
+    static filter parse(std::string_view spec);
+
+    std::int32_t radius() const;
+
+    // row and column vectors whose outer product is the kernel, when it has rank one
+    std::optional<std::pair<std::vector<float>, std::vector<float>>> separate() const;
+};
+
+// runs a filter either as one tiled 2D pass or, for separable kernels, as a
+// row pass into a float scratch buffer followed by a column pass.
+// expects the descriptor set of the caller to be bound with
+// 0 - input image, 1 - output image, 2 - weights(), 3 - scratch of intermediate_size()
+class convolution {
+    filter _filter;
+    bool _separable{false};
+    vulkan::workgroup_size _workgroup{};
+
+    vulkan::device_buffer _weights;
+    vk::raii::Pipeline _full{nullptr};
+    vk::raii::Pipeline _rows{nullptr};
+    vk::raii::Pipeline _cols{nullptr};
+
+  public:
+    struct push_constants {
+        std::int32_t radius;
+        float scale;
+        float bias;
+    };
+
+    static constexpr vk::PushConstantRange push_range() {
+        return {vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants)};
+    }
+
+    convolution() = default;
+    convolution(const vulkan::device& dev, std::uint32_t queue_family, const vk::PipelineLayout& layout, const filter& f, bool allow_separable, vulkan::workgroup_size workgroup);
+
+    // rebuilds the pipelines, nothing recorded with the old ones may still be pending
+    void set_workgroup(const vulkan::device& dev, const vk::PipelineLayout& layout, vulkan::workgroup_size workgroup);
+
+    // shared memory of the 2D pass, its tile always has room for the largest radius
+    static std::uint32_t shared_bytes(vulkan::workgroup_size workgroup);
+
+    bool separable() const;
+    std::int32_t radius() const;
+    const vk::Buffer& weights() const;
+    vk::DeviceSize intermediate_size(vk::Extent3D extent) const;
+
+    void record(const vk::CommandBuffer& cb, const vk::PipelineLayout& layout, vk::Extent3D extent) const;
+};
@@ -0,0 +1,196 @@
+#include "cpu_filter.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define CPU_FILTER_SSE
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#define CPU_FILTER_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// y += a * x, every tap of every filter goes through it
+using axpy_fn = void (*)(float* y, const float* x, float a, std::size_t n);
+
+[[maybe_unused]] void axpy_scalar(float* y, const float* x, float a, std::size_t n) {
+    for (std::size_t i = 0; i < n; ++i) {
+        y[i] += a * x[i];
+    }
+}
+
+#if defined(CPU_FILTER_SSE)
+void axpy_sse(float* y, const float* x, float a, std::size_t n) {
+    const auto va = _mm_set1_ps(a);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+    }
+    axpy_scalar(y + i, x + i, a, n - i);
+}
+
+#if defined(__GNUC__)
+// built for avx2 regardless of the compiler flags, only called when the cpu reports it
+__attribute__((target("avx2,fma"))) void axpy_avx2(float* y, const float* x, float a, std::size_t n) {
+    const auto va = _mm256_set1_ps(a);
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    axpy_scalar(y + i, x + i, a, n - i);
+}
+#endif
+#elif defined(CPU_FILTER_NEON)
+void axpy_neon(float* y, const float* x, float a, std::size_t n) {
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(y + i, vmlaq_n_f32(vld1q_f32(y + i), vld1q_f32(x + i), a));
+    }
+    axpy_scalar(y + i, x + i, a, n - i);
+}
+#endif
+
+struct isa_choice {
+    axpy_fn axpy;
+    std::string_view name;
+};
+
+isa_choice pick_isa() {
+#if defined(CPU_FILTER_SSE)
+#if defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return {axpy_avx2, "avx2"};
+    }
+#endif
+    return {axpy_sse, "sse"};
+#elif defined(CPU_FILTER_NEON)
+    return {axpy_neon, "neon"};
+#else
+    return {axpy_scalar, "scalar"};
+#endif
+}
+
+const isa_choice& isa_selected() {
+    static const isa_choice choice = pick_isa();
+    return choice;
+}
+
+std::uint32_t clamp_row(std::int64_t y, std::uint32_t height) {
+    return static_cast<std::uint32_t>(std::clamp<std::int64_t>(y, 0, height - 1));
+}
+
+// rounds like the unorm conversion of the storage image writes
+void quantize(const float* acc, std::uint8_t* dst, std::uint32_t width, float scale, float bias) {
+    for (std::uint32_t x = 0; x < width; ++x) {
+        for (std::uint32_t c = 0; c < 3; ++c) {
+            const auto v = std::clamp(acc[x * 4 + c] * scale + bias, 0.0f, 1.0f);
+            dst[x * 4 + c] = static_cast<std::uint8_t>(v * 255.0f + 0.5f);
+        }
+        dst[x * 4 + 3] = 255;
+    }
+}
+
+} // namespace
+
+cpu_filter::cpu_filter(const std::vector<filter>& filters, bool allow_separable, std::uint32_t threads)
+    : _pool(std::max(threads, 1u)) {
+    for (const auto& f : filters) {
+        _stages.push_back({f, allow_separable ? f.separate() : std::nullopt});
+    }
+}
+
+std::string_view cpu_filter::isa() {
+    return isa_selected().name;
+}
+
+void cpu_filter::parallel_rows(std::uint32_t height, const std::function<void(std::uint32_t, std::uint32_t)>& rows) {
+    // a few ranges per thread so uneven progress evens out
+    const auto chunk = std::max<std::uint32_t>(height / static_cast<std::uint32_t>(4 * _pool.size()), 1);
+    for (std::uint32_t begin = 0; begin < height; begin += chunk) {
+        const auto end = std::min(begin + chunk, height);
+        _pool.submit([&rows, begin, end] { rows(begin, end); });
+    }
+    _pool.wait();
+}
+
+void cpu_filter::run_stage(const stage& s, const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width, std::uint32_t height) {
+    const auto axpy = isa_selected().axpy;
+    const auto r = static_cast<std::uint32_t>(s.f.radius());
+    const auto n = s.f.size;
+    const auto row_floats = std::size_t{width} * 4;
+
+    // float rows with r clamped pixels on either side, so every tap is one contiguous axpy
+    const auto padded_floats = std::size_t{width + 2 * r} * 4;
+    std::vector<float> input(padded_floats * height);
+    parallel_rows(height, [&](std::uint32_t begin, std::uint32_t end) {
+        for (auto y = begin; y < end; ++y) {
+            const auto* row = src + std::size_t{y} * width * 4;
+            auto* out = input.data() + y * padded_floats;
+            for (std::uint32_t x = 0; x < width + 2 * r; ++x) {
+                const auto sx = clamp_row(std::int64_t{x} - r, width);
+                for (std::uint32_t c = 0; c < 4; ++c) {
+                    out[x * 4 + c] = row[sx * 4 + c] / 255.0f;
+                }
+            }
+        }
+    });
+
+    if (!s.split) {
+        parallel_rows(height, [&](std::uint32_t begin, std::uint32_t end) {
+            std::vector<float> acc(row_floats);
+            for (auto y = begin; y < end; ++y) {
+                std::fill(acc.begin(), acc.end(), 0.0f);
+                for (std::uint32_t dy = 0; dy < n; ++dy) {
+                    const auto* row = input.data() + clamp_row(std::int64_t{y} + dy - r, height) * padded_floats;
+                    for (std::uint32_t dx = 0; dx < n; ++dx) {
+                        if (const auto w = s.f.weights[dy * n + dx]; w != 0.0f) {
+                            axpy(acc.data(), row + dx * 4, w, row_floats);
+                        }
+                    }
+                }
+                quantize(acc.data(), dst + std::size_t{y} * width * 4, width, s.f.scale, s.f.bias);
+            }
+        });
+        return;
+    }
+
+    // rows into an unrounded float image, then columns out of it like the two gpu passes
+    const auto& [row_weights, col_weights] = *s.split;
+    std::vector<float> rows(row_floats * height, 0.0f);
+    parallel_rows(height, [&](std::uint32_t begin, std::uint32_t end) {
+        for (auto y = begin; y < end; ++y) {
+            for (std::uint32_t dx = 0; dx < n; ++dx) {
+                axpy(rows.data() + y * row_floats, input.data() + y * padded_floats + dx * 4, row_weights[dx], row_floats);
+            }
+        }
+    });
+
+    parallel_rows(height, [&](std::uint32_t begin, std::uint32_t end) {
+        std::vector<float> acc(row_floats);
+        for (auto y = begin; y < end; ++y) {
+            std::fill(acc.begin(), acc.end(), 0.0f);
+            for (std::uint32_t dy = 0; dy < n; ++dy) {
+                axpy(acc.data(), rows.data() + clamp_row(std::int64_t{y} + dy - r, height) * row_floats, col_weights[dy], row_floats);
+            }
+            quantize(acc.data(), dst + std::size_t{y} * width * 4, width, s.f.scale, s.f.bias);
+        }
+    });
+}
+
+void cpu_filter::run(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width, std::uint32_t height) {
+    // stages in between ping-pong through two scratch images
+    std::vector<std::uint8_t> scratch[2];
+    const auto* in = src;
+    for (std::size_t i = 0; i < _stages.size(); ++i) {
+        auto* out = dst;
+        if (i + 1 < _stages.size()) {
+            scratch[i % 2].resize(std::size_t{width} * height * 4);
+            out = scratch[i % 2].data();
+        }
+        run_stage(_stages[i], in, out, width, height);
+        in = out;
+    }
+}
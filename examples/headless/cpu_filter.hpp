@@ -0,0 +1,33 @@
+#pragma once
+
+#include "convolution.hpp"
+#include "thread_pool.hpp"
+
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// runs the headless filters without a vulkan device. same math as the kernels:
+// clamped edges, rgb filtered and alpha set to one, every stage rounded to rgba8
+// like the storage images between gpu stages. rows are split across a thread pool
+class cpu_filter {
+    struct stage {
+        filter f;
+        std::optional<std::pair<std::vector<float>, std::vector<float>>> split;
+    };
+
+    std::vector<stage> _stages;
+    common::thread_pool _pool;
+
+    // calls rows with [begin, end) ranges that cover the height, one task per range
+    void parallel_rows(std::uint32_t height, const std::function<void(std::uint32_t, std::uint32_t)>& rows);
+    void run_stage(const stage& s, const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width, std::uint32_t height);
+
+  public:
+    cpu_filter(const std::vector<filter>& filters, bool allow_separable, std::uint32_t threads);
+
+    // the widest instruction set the axpy loops use on this machine
+    static std::string_view isa();
+
+    void run(const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width, std::uint32_t height);
+};
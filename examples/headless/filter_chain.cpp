@@ -0,0 +1,62 @@
+#include "filter_chain.hpp"
+
+#include <algorithm>
+
+filter_chain::filter_chain(const vulkan::device& dev, std::uint32_t queue_family, const vk::PipelineLayout& layout, const std::vector<filter>& filters, bool allow_separable, vulkan::workgroup_size workgroup) {
+    _stages.reserve(filters.size());
+    for (const auto& f : filters) {
+        _stages.emplace_back(dev, queue_family, layout, f, allow_separable, workgroup);
+    }
+}
+
+std::size_t filter_chain::size() const {
+    return _stages.size();
+}
+
+const convolution& filter_chain::stage(std::size_t i) const {
+    return _stages[i];
+}
+
+bool filter_chain::separable() const {
+    return std::any_of(_stages.begin(), _stages.end(), [](const convolution& c) { return c.separable(); });
+}
+
+std::uint32_t filter_chain::radius() const {
+    std::uint32_t radius{};
+    for (const auto& c : _stages) {
+        radius += c.radius();
+    }
+    return radius;
+}
+
+bool filter_chain::result_in_first() const {
+    return _stages.size() % 2 == 0;
+}
+
+vk::DeviceSize filter_chain::intermediate_size(vk::Extent3D extent) const {
+    vk::DeviceSize size{};
+    for (const auto& c : _stages) {
+        size = std::max(size, c.intermediate_size(extent));
+    }
+    return size;
+}
+
+void filter_chain::set_workgroup(const vulkan::device& dev, const vk::PipelineLayout& layout, vulkan::workgroup_size workgroup) {
+    for (auto& c : _stages) {
+        c.set_workgroup(dev, layout, workgroup);
+    }
+}
+
+void filter_chain::record(const vk::CommandBuffer& cb, const vk::PipelineLayout& layout, const std::vector<vk::raii::DescriptorSet>& sets, vk::Extent3D extent) const {
+    for (std::size_t i = 0; i < _stages.size(); ++i) {
+        if (i > 0) {
+            // the next stage reads what this one wrote and overwrites what it read.
+            // both images stay in general layout, so a global compute to compute barrier is enough
+            vk::MemoryBarrier barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+            cb.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+        }
+
+        cb.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, 0, *sets[i], nullptr);
+        _stages[i].record(cb, layout, extent);
+    }
+}
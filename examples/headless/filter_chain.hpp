@@ -0,0 +1,32 @@
+#pragma once
+
+#include "convolution.hpp"
+
+#include <vector>
+
+// filters applied one after the other in one command buffer. the stages ping-pong
+// between two images, so the chain length does not change the memory it needs.
+// stage i uses descriptor set i, which the caller binds with the two images swapped
+// on odd stages and with the weights of stage i. the scratch buffer is shared
+class filter_chain {
+    std::vector<convolution> _stages;
+
+  public:
+    filter_chain() = default;
+    filter_chain(const vulkan::device& dev, std::uint32_t queue_family, const vk::PipelineLayout& layout, const std::vector<filter>& filters, bool allow_separable, vulkan::workgroup_size workgroup);
+
+    std::size_t size() const;
+    const convolution& stage(std::size_t i) const;
+
+    // whether any stage runs the two pass path
+    bool separable() const;
+    // the halo a tile needs for the whole chain, the radii add up
+    std::uint32_t radius() const;
+    // true when the last stage writes to the first image again
+    bool result_in_first() const;
+    vk::DeviceSize intermediate_size(vk::Extent3D extent) const;
+
+    void set_workgroup(const vulkan::device& dev, const vk::PipelineLayout& layout, vulkan::workgroup_size workgroup);
+
+    void record(const vk::CommandBuffer& cb, const vk::PipelineLayout& layout, const std::vector<vk::raii::DescriptorSet>& sets, vk::Extent3D extent) const;
+};
@@ -1,6 +1,29 @@
+#include "cpu_filter.hpp"
+#include "filter_chain.hpp"
+#include "gpu_profiler.hpp"
+#include "image_stats.hpp"
+#include "thread_pool.hpp"
+#include "transfer.hpp"
 #include "vulkan.hpp"
+#include "workgroup.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
 #include <fmt/core.h>
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -10,6 +33,9 @@
 #include <stb_image_write.h>
 
 #include <headless.comp.hpp>
+#include <headless_buffer.comp.hpp>
+#include <headless_tiled.comp.hpp>
+#include <headless_tiled_fp16.comp.hpp>
 
 constexpr static const char* layers[] = {
     "VK_LAYER_KHRONOS_validation",
@@ -24,18 +50,268 @@ constexpr static vk::ApplicationInfo app_info = {
     1,
     "engine",
     1,
-    VK_API_VERSION_1_0,
+    VK_API_VERSION_1_1,
+};
+
+using clock_type = std::chrono::steady_clock;
+
+double to_ms(clock_type::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+// naive loads its 3x3 neighbourhood per invocation, tiled shares a tile with halo per workgroup,
+// convolve runs the chain of filters given with --filter
+enum class kernel {
+    naive,
+    tiled,
+    convolve,
+};
+
+// image copies the pixels into storage images and back, buffer lets the kernel read and write
+// packed rgba8 storage buffers in host visible memory, compare benchmarks both
+enum class data_path {
+    image,
+    buffer,
+    compare,
+};
+
+// arithmetic of the tiled kernel on the image path. automatic takes fp16 when the
+// device supports it, compare benchmarks both and reports how far apart they are
+enum class precision {
+    automatic,
+    fp32,
+    fp16,
+    compare,
 };
 
+// automatic takes the gpu when a vulkan device exists and the cpu otherwise
+enum class backend {
+    automatic,
+    gpu,
+    cpu,
+};
+
+struct options {
+    std::vector<std::filesystem::path> inputs;
+    kernel sharpen{kernel::tiled};
+    // applied in the order given
+    std::vector<filter> filters{};
+    bool separable{true};
+    data_path path{data_path::image};
+    precision arithmetic{precision::automatic};
+    backend engine{backend::automatic};
+    // reads back per-channel statistics instead of the filtered image
+    bool stats_only{false};
+    // runs the image on both backends and compares the results
+    bool parity{false};
+    std::uint32_t tolerance{1};
+    // tile edge for streaming large images, 0 tiles only what exceeds the device limits
+    std::uint32_t tile{0};
+    // forced with --workgroup, otherwise taken from the tune cache
+    std::optional<vulkan::workgroup_size> workgroup{};
+    bool autotune{false};
+    std::filesystem::path tune_cache{"headless.tune"};
+    std::filesystem::path output{"."};
+    std::uint32_t inflight{3};
+    std::uint32_t iterations{20};
+    // workers of the cpu backend, batch mode also splits them into decoders and encoders
+    std::uint32_t threads{std::max(std::thread::hardware_concurrency(), 2u)};
+};
+
+options parse_options(int argc, char** argv) {
+    options opts{};
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg{argv[i]};
+        if (arg == "--inflight" && i + 1 < argc) {
+            opts.inflight = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            opts.iterations = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            opts.threads = std::max(std::stoi(argv[++i]), 1);
+        } else if (arg == "--output" && i + 1 < argc) {
+            opts.output = argv[++i];
+        } else if (arg == "--kernel" && i + 1 < argc) {
+            const std::string_view name{argv[++i]};
+            if (name != "naive" && name != "tiled") {
+                throw std::runtime_error("kernel has to be naive or tiled");
+            }
+            opts.sharpen = name == "naive" ? kernel::naive : kernel::tiled;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            opts.filters.push_back(filter::parse(argv[++i]));
+            opts.sharpen = kernel::convolve;
+        } else if (arg == "--no-separable") {
+            opts.separable = false;
+        } else if (arg == "--path" && i + 1 < argc) {
+            const std::string_view name{argv[++i]};
+            if (name != "image" && name != "buffer" && name != "compare") {
+                throw std::runtime_error("path has to be image, buffer or compare");
+            }
+            opts.path = name == "image" ? data_path::image : name == "buffer" ? data_path::buffer : data_path::compare;
+        } else if (arg == "--precision" && i + 1 < argc) {
+            const std::string_view name{argv[++i]};
+            if (name != "auto" && name != "fp32" && name != "fp16" && name != "compare") {
+                throw std::runtime_error("precision has to be auto, fp32, fp16 or compare");
+            }
+            opts.arithmetic = name == "auto" ? precision::automatic : name == "fp32" ? precision::fp32 : name == "fp16" ? precision::fp16 : precision::compare;
+        } else if (arg == "--backend" && i + 1 < argc) {
+            const std::string_view name{argv[++i]};
+            if (name != "auto" && name != "gpu" && name != "cpu") {
+                throw std::runtime_error("backend has to be auto, gpu or cpu");
+            }
+            opts.engine = name == "auto" ? backend::automatic : name == "gpu" ? backend::gpu : backend::cpu;
+        } else if (arg == "--stats") {
+            opts.stats_only = true;
+        } else if (arg == "--parity") {
+            opts.parity = true;
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            opts.tolerance = std::max(std::stoi(argv[++i]), 0);
+        } else if (arg == "--tile" && i + 1 < argc) {
+            opts.tile = std::max(std::stoi(argv[++i]), 16);
+        } else if (arg == "--workgroup" && i + 1 < argc) {
+            const std::string size{argv[++i]};
+            const auto x = size.find('x');
+            if (x == std::string::npos) {
+                throw std::runtime_error("workgroup has to be given as XxY");
+            }
+            opts.workgroup = vulkan::workgroup_size{
+                static_cast<std::uint32_t>(std::max(std::stoi(size.substr(0, x)), 1)),
+                static_cast<std::uint32_t>(std::max(std::stoi(size.substr(x + 1)), 1)),
+            };
+        } else if (arg == "--autotune") {
+            opts.autotune = true;
+        } else if (arg == "--tune-cache" && i + 1 < argc) {
+            opts.tune_cache = argv[++i];
+        } else {
+            opts.inputs.emplace_back(argv[i]);
+        }
+    }
+
+    if (opts.path != data_path::image && opts.sharpen != kernel::tiled) {
+        throw std::runtime_error("the buffer path only runs the tiled kernel");
+    }
+    const auto half = opts.arithmetic == precision::fp16 || opts.arithmetic == precision::compare;
+    if (half && (opts.path != data_path::image || opts.sharpen != kernel::tiled)) {
+        throw std::runtime_error("fp16 is only available for the tiled kernel on the image path");
+    }
+    if (opts.stats_only && (opts.path != data_path::image || opts.parity || opts.arithmetic == precision::compare)) {
+        throw std::runtime_error("stats only runs on the image path and compares nothing");
+    }
+
+    if (opts.inputs.empty()) {
+        throw std::runtime_error("usage: headless [--inflight n] [--iterations n] [--threads n] [--output dir] [--kernel naive|tiled] [--filter spec]... [--no-separable] [--path image|buffer|compare] [--precision auto|fp32|fp16|compare] [--backend auto|gpu|cpu] [--stats] [--parity] [--tolerance n] [--tile n] [--workgroup XxY] [--autotune] [--tune-cache file] image|dir...\n"
+                                 "parity check of both backends on one image, e.g. on lavapipe:\n"
+                                 "  VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json headless --parity [--tolerance n] [--threads n] image");
+    }
+
+    return opts;
+}
+
+// directories are expanded to the images they contain, in name order
+std::vector<std::filesystem::path> collect_images(const std::vector<std::filesystem::path>& inputs) {
+    const auto is_image = [](const std::filesystem::path& p) {
+        auto ext = p.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        return ext == ".jpg" || ext == ".jpeg" || ext == ".png" || ext == ".bmp" || ext == ".tga";
+    };
+
+    std::vector<std::filesystem::path> files{};
+    for (const auto& input : inputs) {
+        if (!std::filesystem::is_directory(input)) {
+            files.push_back(input);
+            continue;
+        }
+
+        std::vector<std::filesystem::path> entries{};
+        for (const auto& entry : std::filesystem::directory_iterator{input}) {
+            if (entry.is_regular_file() && is_image(entry.path())) {
+                entries.push_back(entry.path());
+            }
+        }
+        std::sort(entries.begin(), entries.end());
+        files.insert(files.end(), entries.begin(), entries.end());
+    }
+
+    return files;
+}
+
+// images of different directories may share a stem, later ones get a counter so nothing is overwritten
+std::vector<std::filesystem::path> output_names(const std::filesystem::path& output, const std::vector<std::filesystem::path>& files) {
+    std::unordered_set<std::string> taken{};
+    std::vector<std::filesystem::path> names{};
+    names.reserve(files.size());
+    for (const auto& file : files) {
+        const auto stem = file.stem().string();
+        auto name = stem + "_sharpened.jpg";
+        for (std::size_t n = 1; !taken.insert(name).second; ++n) {
+            name = fmt::format("{}_{}_sharpened.jpg", stem, n);
+        }
+        names.push_back(output / name);
+    }
+    return names;
+}
+
+// also the tune cache key, so it must not contain spaces. a chain shares one workgroup size,
+// its key names every stage so chains of different composition are tuned apart
+std::string kernel_name(kernel k, const std::vector<filter>& filters, bool allow_separable, bool buffer, bool half) {
+    switch (k) {
+    case kernel::naive:
+        return "naive";
+    case kernel::tiled:
+        return buffer ? "tiled-buffer" : half ? "tiled-fp16" : "tiled";
+    case kernel::convolve: {
+        std::string name{};
+        for (const auto& f : filters) {
+            if (!name.empty()) {
+                name += '+';
+            }
+            name += allow_separable && f.separate() ? "convolve-separable" : "convolve";
+        }
+        return name;
+    }
+    }
+    return {};
+}
+
 struct headless {
-    static constexpr auto local_size = 32;
+    using clock = clock_type;
 
-    vulkan::device _device;
-    vulkan::texture _input_texture;
-    vulkan::texture _output_texture;
-    vulkan::host_buffer _staging;
+    // push constants of the buffer path, shares the range with the convolution ones
+    struct buffer_push_constants {
+        std::uint32_t width;
+        std::uint32_t height;
+    };
+
+    // everything one image needs while it is in flight.
+    // on the buffer path upload and readback are bound to the kernel and the textures stay empty
+    struct slot {
+        vulkan::host_buffer upload;
+        vulkan::host_buffer readback;
+        vulkan::texture input;
+        vulkan::texture output;
+        // float row pass results, only used by separable convolutions
+        vulkan::device_buffer intermediate;
+        // what the stats kernel reduces into, replaces readback in stats-only mode
+        vulkan::host_buffer stats;
+        // the part of the result the statistics cover
+        vk::Rect2D region{};
+        // one per chain stage with the images swapped on odd stages, just the first otherwise
+        std::vector<vk::raii::DescriptorSet> descriptor_sets{};
+        vk::raii::CommandBuffer command_buffer{nullptr};
+        vk::raii::Fence fence{nullptr};
+        vk::Extent3D extent{};
+
+        // reads the result out of the mapped readback memory
+        std::function<void(const std::uint8_t*)> done{};
+        clock::time_point submitted{};
+        bool busy{false};
+    };
 
-    vk::DeviceSize _buffer_size;
+    struct timing {
+        clock::time_point submitted;
+        clock::time_point retired;
+    };
+
+    vulkan::device _device;
 
     vk::raii::DescriptorPool _descriptor_pool{nullptr};
 
@@ -43,14 +319,35 @@ struct headless {
     std::uint32_t _queue_index{};
 
     vk::raii::DescriptorSetLayout _descriptor_layout{nullptr};
-    vk::raii::DescriptorSet _descriptor_set{nullptr};
     vk::raii::Pipeline _pipeline{nullptr};
     vk::raii::PipelineLayout _pipeline_layout{nullptr};
     vk::raii::CommandPool _command_pool{nullptr};
-    vk::raii::CommandBuffer _command_buffer{nullptr};
-    vk::raii::Fence _fence{nullptr};
+    kernel _kernel{};
+    bool _buffer_path{false};
+    bool _half{false};
+    std::string _kernel_name{};
+    // some chain stage runs the 2D pass, which holds a tile with halo in shared memory
+    bool _full_tile{false};
+    bool _stats_only{false};
+    vulkan::workgroup_size _workgroup{};
+    filter_chain _chain;
+    image_stats _stats;
+
+    std::vector<slot> _slots;
+    std::uint32_t _next{};
+    std::vector<timing> _timings;
+
+    // per-pass gpu time summed over every resolved slot
+    vulkan::gpu_profiler _profiler;
+    std::vector<vulkan::gpu_profiler::result> _pass_ms;
+    std::size_t _profiled{};
+
+    // opts.path has to be image or buffer here, compare is resolved by the caller.
+    // a precision of compare is treated like automatic
+    explicit headless(const options& opts)
+        : _kernel(opts.sharpen), _buffer_path(opts.path == data_path::buffer), _stats_only(opts.stats_only) {
+        const auto inflight = opts.inflight;
 
-    headless() {
         _device = vulkan::device{
             app_info,
             layers,
@@ -58,89 +355,273 @@ struct headless {
             extensions,
             vk::QueueFlagBits::eCompute,
             true,
+            vulkan::device_features{opts.arithmetic != precision::fp32},
         };
 
+        // the fp16 kernel replaces the tiled one on the image path only
+        if (_kernel == kernel::tiled && !_buffer_path && opts.arithmetic != precision::fp32) {
+            _half = _device.features().float16;
+            if (!_half && opts.arithmetic == precision::fp16) {
+                throw std::runtime_error("the device has no float16 support");
+            }
+        }
+
+        _slots.resize(inflight);
+
+        const auto stages = _kernel == kernel::convolve ? static_cast<std::uint32_t>(opts.filters.size()) : 1u;
+        const auto sets = inflight * stages;
         vk::DescriptorPoolSize sizes[] = {
-            {vk::DescriptorType::eStorageImage, 2},
+            {vk::DescriptorType::eStorageImage, 2 * sets},
+            {vk::DescriptorType::eStorageBuffer, 5 * sets},
         };
 
-        vk::DescriptorPoolCreateInfo dpci{vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 2, sizes};
+        vk::DescriptorPoolCreateInfo dpci{vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, sets, sizes};
         _descriptor_pool = _device.make_descriptor_pool(dpci);
 
         _queue = _device.compute_queue();
-        _queue_index = _device.queue_family_index(vk::QueueFlagBits::eCompute);
+        _queue_index = _device.compute_queue_index();
 
         vk::DescriptorSetLayoutBinding bindings[] = {
             {0, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute},
             {1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute},
+            {2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+            {3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+            {4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+            {5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
+            {6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute},
         };
 
         vk::DescriptorSetLayoutCreateInfo dslci{{}, bindings};
         _descriptor_layout = _device.make_descriptor_set_layout(dslci);
 
-        vk::PipelineLayoutCreateInfo plci{{}, *_descriptor_layout};
+        const vk::PushConstantRange push_range{
+            vk::ShaderStageFlagBits::eCompute,
+            0,
+            std::max({convolution::push_range().size, image_stats::push_range().size, std::uint32_t{sizeof(buffer_push_constants)}}),
+        };
+        vk::PipelineLayoutCreateInfo plci{{}, *_descriptor_layout, push_range};
         _pipeline_layout = _device.make_pipeline_layout(plci);
 
-        vk::DescriptorSetAllocateInfo dsai{_descriptor_pool, *_descriptor_layout};
-        _descriptor_set = std::move(_device.make_descriptor_sets(dsai).front());
+        const std::vector<vk::DescriptorSetLayout> set_layouts(stages, *_descriptor_layout);
+        vk::DescriptorSetAllocateInfo dsai{_descriptor_pool, set_layouts};
+
+        // an explicit size wins over the tuned one, which wins over the default
+        _kernel_name = ::kernel_name(_kernel, opts.filters, opts.separable, _buffer_path, _half);
+        _full_tile = _kernel == kernel::convolve && std::any_of(opts.filters.begin(), opts.filters.end(), [&](const filter& f) {
+                         return !opts.separable || !f.separate().has_value();
+                     });
+        if (opts.workgroup && !vulkan::workgroup_fits(_device, *opts.workgroup, [this](vulkan::workgroup_size size) { return shared_bytes(size); })) {
+            throw std::runtime_error(fmt::format("workgroup {}x{} exceeds the device limits", opts.workgroup->x, opts.workgroup->y));
+        }
+        const auto tuned = vulkan::workgroup_cache{_device, opts.tune_cache}.find(_kernel_name);
+        _workgroup = opts.workgroup.value_or(tuned.value_or(vulkan::workgroup_size{}));
+
+        if (_kernel == kernel::convolve) {
+            _chain = filter_chain{_device, _queue_index, *_pipeline_layout, opts.filters, opts.separable, _workgroup};
+        } else {
+            _pipeline = make_pipeline();
+        }
+        if (_stats_only) {
+            _stats = image_stats{_device, *_pipeline_layout};
+        }
 
-        const auto comp_shader = _device.make_shader_module({{}, headless_comp::size, headless_comp::code});
+        _command_pool = _device.make_command_pool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer, _queue_index});
+        vk::CommandBufferAllocateInfo cbai{_command_pool, vk::CommandBufferLevel::ePrimary, inflight};
+        auto command_buffers = _device.make_command_buffers(cbai);
+
+        for (std::uint32_t i = 0; i < inflight; ++i) {
+            _slots[i].descriptor_sets = _device.make_descriptor_sets(dsai);
+            _slots[i].command_buffer = std::move(command_buffers[i]);
+            _slots[i].fence = _device.make_fence({vk::FenceCreateFlagBits::eSignaled});
+        }
+
+        _profiler = vulkan::gpu_profiler{_device, _queue_index, inflight};
+    }
+
+    vk::raii::Pipeline make_pipeline() const {
+        const auto comp_shader = _buffer_path                ? _device.make_shader_module({{}, headless_buffer_comp::size, headless_buffer_comp::code})
+                                 : _half                    ? _device.make_shader_module({{}, headless_tiled_fp16_comp::size, headless_tiled_fp16_comp::code})
+                                 : _kernel == kernel::tiled ? _device.make_shader_module({{}, headless_tiled_comp::size, headless_tiled_comp::code})
+                                                            : _device.make_shader_module({{}, headless_comp::size, headless_comp::code});
+        const vulkan::workgroup_specialization specialization{_workgroup};
         vk::PipelineShaderStageCreateInfo pssci{
-            vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eCompute, comp_shader, "main"},
+            vk::PipelineShaderStageCreateInfo{{}, vk::ShaderStageFlagBits::eCompute, comp_shader, "main", specialization.info()},
         };
         vk::ComputePipelineCreateInfo cpci{{}, pssci, _pipeline_layout};
-        _pipeline = _device.make_pipeline(cpci);
+        return _device.make_pipeline(cpci);
+    }
 
-        _command_pool = _device.make_command_pool({vk::CommandPoolCreateFlagBits::eResetCommandBuffer, _queue_index});
-        vk::CommandBufferAllocateInfo cbai{_command_pool, vk::CommandBufferLevel::ePrimary, 1};
-        _command_buffer = std::move(_device.make_command_buffers(cbai).front());
+    // drains the slots before the pipelines are replaced
+    void set_workgroup(vulkan::workgroup_size size) {
+        flush();
 
-        _fence = _device.make_fence({vk::FenceCreateFlagBits::eSignaled});
+        _workgroup = size;
+        if (_kernel == kernel::convolve) {
+            _chain.set_workgroup(_device, *_pipeline_layout, _workgroup);
+        } else {
+            _pipeline = make_pipeline();
+        }
     }
 
-    void resize(std::uint32_t width, std::uint32_t height) {
+    // shared memory per workgroup of the current kernel, checked against the limit for tuned and explicit sizes
+    std::uint32_t shared_bytes(vulkan::workgroup_size size) const {
+        if (_half) {
+            // f16vec3 pads to 8 bytes
+            return (size.x + 2) * (size.y + 2) * 8;
+        }
+        if (_kernel == kernel::tiled || _buffer_path) {
+            return (size.x + 2) * (size.y + 2) * 16;
+        }
+        return _full_tile ? convolution::shared_bytes(size) : 0;
+    }
+
+    // (re)creates the buffers and images of a retired slot for a new extent
+    void prepare(slot& s, std::uint32_t width, std::uint32_t height, vulkan::upload_batch& batch) {
+        s.extent = vk::Extent3D{width, height, 1};
+
         const vk::DeviceSize dev_size = width * height * 4;
-        _staging = {
+        if (_buffer_path) {
+            prepare_buffers(s, dev_size);
+            return;
+        }
+
+        s.upload = {
             _device,
             dev_size,
-            vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+            vk::BufferUsageFlagBits::eTransferSrc,
+            vulkan::memory_usage::upload,
         };
 
-        _input_texture = {
+        if (_stats_only) {
+            s.stats = {
+                _device,
+                image_stats::buffer_size(),
+                vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+                vulkan::memory_usage::readback,
+            };
+
+            // the stats kernel runs with the set of the last stage, whose output is the result
+            vk::DescriptorBufferInfo stats_dbi{s.stats.buf(), 0, VK_WHOLE_SIZE};
+            _device.logical().updateDescriptorSets(vk::WriteDescriptorSet{s.descriptor_sets.back(), 6, 0, vk::DescriptorType::eStorageBuffer, nullptr, stats_dbi}, nullptr);
+        } else {
+            s.readback = {
+                _device,
+                dev_size,
+                vk::BufferUsageFlagBits::eTransferDst,
+                vulkan::memory_usage::readback,
+            };
+        }
+
+        // even length chains end in the input image, so it is read back as well
+        s.input = {
             _device,
             width,
             height,
-            vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst,
+            vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc,
         };
-        _device.image_transition(_input_texture.image(), vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
 
-        _output_texture = {
+        s.output = {
             _device,
             width,
             height,
             vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eTransferSrc,
         };
-        _device.image_transition(_output_texture.image(), vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
 
-        vk::DescriptorImageInfo input_dii{_input_texture.sampler(), _input_texture.view(), vk::ImageLayout::eGeneral};
-        vk::DescriptorImageInfo output_dii{_output_texture.sampler(), _output_texture.view(), vk::ImageLayout::eGeneral};
+        batch.image_transition(s.input.image(), vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral)
+            .image_transition(s.output.image(), vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+
+        vk::DescriptorImageInfo input_dii{s.input.sampler(), s.input.view(), vk::ImageLayout::eGeneral};
+        vk::DescriptorImageInfo output_dii{s.output.sampler(), s.output.view(), vk::ImageLayout::eGeneral};
+        if (_kernel != kernel::convolve) {
+            vk::WriteDescriptorSet wds[] = {
+                vk::WriteDescriptorSet{s.descriptor_sets[0], 0, 0, vk::DescriptorType::eStorageImage, input_dii},
+                vk::WriteDescriptorSet{s.descriptor_sets[0], 1, 0, vk::DescriptorType::eStorageImage, output_dii},
+            };
+
+            _device.logical().updateDescriptorSets(wds, nullptr);
+            return;
+        }
+
+        if (_chain.separable()) {
+            s.intermediate = {_device, _chain.intermediate_size(s.extent), vk::BufferUsageFlagBits::eStorageBuffer};
+        }
+
+        for (std::size_t i = 0; i < _chain.size(); ++i) {
+            const auto& set = s.descriptor_sets[i];
+            const auto odd = i % 2 == 1;
+
+            vk::DescriptorBufferInfo weights_dbi{_chain.stage(i).weights(), 0, VK_WHOLE_SIZE};
+            vk::WriteDescriptorSet wds[] = {
+                vk::WriteDescriptorSet{set, 0, 0, vk::DescriptorType::eStorageImage, odd ? output_dii : input_dii},
+                vk::WriteDescriptorSet{set, 1, 0, vk::DescriptorType::eStorageImage, odd ? input_dii : output_dii},
+                vk::WriteDescriptorSet{set, 2, 0, vk::DescriptorType::eStorageBuffer, nullptr, weights_dbi},
+            };
+            _device.logical().updateDescriptorSets(wds, nullptr);
+
+            if (_chain.stage(i).separable()) {
+                vk::DescriptorBufferInfo intermediate_dbi{s.intermediate.buf(), 0, VK_WHOLE_SIZE};
+                _device.logical().updateDescriptorSets(vk::WriteDescriptorSet{set, 3, 0, vk::DescriptorType::eStorageBuffer, nullptr, intermediate_dbi}, nullptr);
+            }
+        }
+    }
+
+    // the kernel works on the mapped memory itself. dynamic memory is device local where the
+    // host can map it (uma, rebar), the output is cached for the host read in copy_to
+    void prepare_buffers(slot& s, vk::DeviceSize size) {
+        s.upload = {
+            _device,
+            size,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vulkan::memory_usage::dynamic,
+        };
+
+        s.readback = {
+            _device,
+            size,
+            vk::BufferUsageFlagBits::eStorageBuffer,
+            vulkan::memory_usage::readback,
+        };
+
+        vk::DescriptorBufferInfo input_dbi{s.upload.buf(), 0, VK_WHOLE_SIZE};
+        vk::DescriptorBufferInfo output_dbi{s.readback.buf(), 0, VK_WHOLE_SIZE};
         vk::WriteDescriptorSet wds[] = {
-            vk::WriteDescriptorSet{_descriptor_set, 0, 0, vk::DescriptorType::eStorageImage, input_dii},
-            vk::WriteDescriptorSet{_descriptor_set, 1, 0, vk::DescriptorType::eStorageImage, output_dii},
+            vk::WriteDescriptorSet{s.descriptor_sets[0], 4, 0, vk::DescriptorType::eStorageBuffer, nullptr, input_dbi},
+            vk::WriteDescriptorSet{s.descriptor_sets[0], 5, 0, vk::DescriptorType::eStorageBuffer, nullptr, output_dbi},
         };
 
         _device.logical().updateDescriptorSets(wds, nullptr);
     }
 
-    void process_image(const void* src, void* dst, std::int32_t w, std::int32_t h, std::int32_t channels = 4) {
-        const vk::DeviceSize dev_size = w * h * 4;
-        _staging.copy(src, dev_size);
+    void resize(std::uint32_t width, std::uint32_t height) {
+        flush();
+
+        vulkan::upload_batch batch{_device, _queue_index};
+        for (auto& s : _slots) {
+            prepare(s, width, height, batch);
+        }
+        batch.submit().wait();
+    }
+
+    std::uint32_t slot_index(const slot& s) const {
+        return static_cast<std::uint32_t>(&s - _slots.data());
+    }
+
+    void record(slot& s) {
+        const auto& cb = s.command_buffer;
 
-        _command_buffer.begin({});
-        vulkan::utils::copy_buffer_to_image(*_command_buffer, _staging.buf(), _input_texture.image(), _input_texture.extent(), vk::ImageLayout::eGeneral);
-        _command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, _pipeline);
-        _command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _pipeline_layout, 0, *_descriptor_set, nullptr);
-        _command_buffer.dispatch(_input_texture.extent().width / local_size, _input_texture.extent().height / local_size, 1);
+        cb.reset();
+        cb.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+        _profiler.reset(*cb, slot_index(s));
+
+        if (_buffer_path) {
+            record_buffers(s);
+            return;
+        }
+
+        // both images stay in general layout, so only the accesses need ordering.
+        // the copy overwrites what the previous use of the slot read and wrote
+        vk::MemoryBarrier upload_barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferWrite};
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {}, upload_barrier, nullptr, nullptr);
 
         vk::BufferImageCopy bic{
             0,
@@ -148,57 +629,824 @@ struct headless {
             0,
             {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
             {0, 0, 0},
-            _output_texture.extent(),
+            s.extent,
         };
-        _command_buffer.copyImageToBuffer(_output_texture.image(), vk::ImageLayout::eGeneral, _staging.buf(), bic);
-        _command_buffer.end();
+        auto marker = _profiler.begin(*cb, "upload");
+        cb.copyBufferToImage(s.upload.buf(), s.input.image(), vk::ImageLayout::eGeneral, bic);
+        _profiler.end(*cb, marker);
+
+        vk::MemoryBarrier input_barrier{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead};
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, input_barrier, nullptr, nullptr);
+
+        marker = _profiler.begin(*cb, _kernel == kernel::convolve ? "filter" : "sharpen");
+        if (_kernel == kernel::convolve) {
+            _chain.record(*cb, *_pipeline_layout, s.descriptor_sets, s.extent);
+        } else {
+            cb.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _pipeline_layout, 0, *s.descriptor_sets[0], nullptr);
+            cb.bindPipeline(vk::PipelineBindPoint::eCompute, _pipeline);
+            cb.dispatch(_workgroup.groups_x(s.extent.width), _workgroup.groups_y(s.extent.height), 1);
+        }
+        _profiler.end(*cb, marker);
+
+        if (_stats_only) {
+            record_stats(s);
+            return;
+        }
+
+        vk::MemoryBarrier dispatch_barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead};
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, dispatch_barrier, nullptr, nullptr);
+
+        // an even chain ends up back in the input image
+        const auto& result = _kernel == kernel::convolve && _chain.result_in_first() ? s.input : s.output;
+        marker = _profiler.begin(*cb, "readback");
+        cb.copyImageToBuffer(result.image(), vk::ImageLayout::eGeneral, s.readback.buf(), bic);
+        _profiler.end(*cb, marker);
+
+        // makes the copy visible to the host read in copy_to
+        vk::MemoryBarrier readback_barrier{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead};
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, readback_barrier, nullptr, nullptr);
+        cb.end();
+    }
+
+    // reduces the result on the gpu, the host only reads the few KiB of the stats buffer
+    void record_stats(slot& s) {
+        const auto& cb = s.command_buffer;
+
+        vk::MemoryBarrier result_barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead};
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, result_barrier, nullptr, nullptr);
+
+        const auto marker = _profiler.begin(*cb, "stats");
+        cb.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _pipeline_layout, 0, *s.descriptor_sets.back(), nullptr);
+        _stats.record(*cb, *_pipeline_layout, s.stats.buf(), s.region);
+        _profiler.end(*cb, marker);
 
-        _device.logical().resetFences(*_fence);
+        vk::MemoryBarrier readback_barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead};
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, readback_barrier, nullptr, nullptr);
+        cb.end();
+    }
+
+    // no copies, the host writes and reads the buffers the kernel uses.
+    // the submit makes the host writes visible, the barrier covers the host read
+    void record_buffers(slot& s) {
+        const auto& cb = s.command_buffer;
+
+        const buffer_push_constants pc{s.extent.width, s.extent.height};
+        const auto marker = _profiler.begin(*cb, "sharpen");
+        cb.bindPipeline(vk::PipelineBindPoint::eCompute, _pipeline);
+        cb.bindDescriptorSets(vk::PipelineBindPoint::eCompute, _pipeline_layout, 0, *s.descriptor_sets[0], nullptr);
+        cb.pushConstants<buffer_push_constants>(*_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, pc);
+        cb.dispatch(_workgroup.groups_x(s.extent.width), _workgroup.groups_y(s.extent.height), 1);
+        _profiler.end(*cb, marker);
+
+        vk::MemoryBarrier readback_barrier{vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead};
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, readback_barrier, nullptr, nullptr);
+        cb.end();
+    }
+
+    // waits for the slot, copies its result out and runs its completion callback
+    void retire(slot& s) {
+        if (!s.busy) {
+            return;
+        }
+
+        while (vk::Result::eTimeout == _device.logical().waitForFences(*s.fence, vk::True, -1)) {
+        }
+
+        s.busy = false;
+
+        if (_profiler.resolve(slot_index(s))) {
+            const auto& results = _profiler.results();
+            _pass_ms.resize(results.size());
+            for (std::size_t i = 0; i < results.size(); ++i) {
+                _pass_ms[i].name = results[i].name;
+                _pass_ms[i].ms += results[i].ms;
+            }
+            ++_profiled;
+        }
+
+        _timings.push_back({s.submitted, clock::now()});
+
+        if (auto done = std::move(s.done)) {
+            const auto& result = _stats_only ? s.stats : s.readback;
+            result.invalidate();
+            done(static_cast<const std::uint8_t*>(result.mapped()));
+        }
+    }
+
+    // queues one image, only blocks when the oldest slot is still in flight.
+    // src is copied right away, dst has to stay valid until done is called
+    // from a later submit or flush
+    void submit(const void* src, void* dst, std::uint32_t width, std::uint32_t height, std::function<void()> done = {}) {
+        const auto size = std::size_t{width} * height * 4;
+        submit_mapped(
+            width,
+            height,
+            [&](std::uint8_t* input) { std::memcpy(input, src, size); },
+            [dst, size, done = std::move(done)](const std::uint8_t* result) {
+                std::memcpy(dst, result, size);
+                if (done) {
+                    done();
+                }
+            });
+    }
+
+    // stats-only counterpart of submit, done gets the statistics of the whole image
+    void submit_stats(const void* src, std::uint32_t width, std::uint32_t height, std::function<void(const image_statistics&)> done) {
+        const auto size = std::size_t{width} * height * 4;
+        submit_mapped(
+            width,
+            height,
+            [&](std::uint8_t* input) { std::memcpy(input, src, size); },
+            [done = std::move(done)](const std::uint8_t* stats) { done(image_statistics::read(stats)); });
+    }
+
+    // fill writes the rgba8 input straight into the mapped upload memory,
+    // done reads the result from the mapped readback memory when the slot retires.
+    // in stats-only mode done gets the stats buffer of region instead, the whole image by default
+    void submit_mapped(std::uint32_t width, std::uint32_t height, const std::function<void(std::uint8_t*)>& fill, std::function<void(const std::uint8_t*)> done, vk::Rect2D region = {}) {
+        auto& s = _slots[_next];
+        _next = (_next + 1) % _slots.size();
+
+        retire(s);
+
+        s.submitted = clock::now();
+        if (s.extent != vk::Extent3D{width, height, 1}) {
+            vulkan::upload_batch batch{_device, _queue_index};
+            prepare(s, width, height, batch);
+            batch.submit().wait();
+        }
+
+        s.region = region.extent.width ? region : vk::Rect2D{{0, 0}, {width, height}};
+        fill(static_cast<std::uint8_t*>(s.upload.mapped()));
+        s.upload.flush();
+        record(s);
+
+        _device.logical().resetFences(*s.fence);
         vk::SubmitInfo info{
             nullptr,
             {},
-            *_command_buffer,
+            *s.command_buffer,
         };
-        _queue.submit(info, _fence);
-        const auto res = _device.logical().waitForFences(*_fence, vk::True, -1);
+        _queue.submit(info, *s.fence);
 
-        _staging.copy_to(dst, dev_size);
+        s.done = std::move(done);
+        s.busy = true;
+    }
+
+    // retires all slots in submission order
+    void flush() {
+        for (std::size_t i = 0; i < _slots.size(); ++i) {
+            retire(_slots[(_next + i) % _slots.size()]);
+        }
     }
 
     void wait_idle() {
         _device.logical().waitIdle();
     }
+
+    // pixels around a tile the kernel reads on top of the ones it writes
+    std::uint32_t halo() const {
+        return _kernel == kernel::convolve ? _chain.radius() : 1;
+    }
+
+    // images beyond the 2D image or storage buffer limits have to be tiled
+    bool fits(std::uint32_t width, std::uint32_t height) const {
+        const auto limits = _device.physical().getProperties().limits;
+        if (_buffer_path) {
+            return std::uint64_t{width} * height * 4 <= limits.maxStorageBufferRange;
+        }
+        return width <= limits.maxImageDimension2D && height <= limits.maxImageDimension2D;
+    }
+
+    // largest tile edge whose padded extent still fits
+    std::uint32_t max_tile() const {
+        const auto limits = _device.physical().getProperties().limits;
+        const auto edge = _buffer_path ? static_cast<std::uint32_t>(std::sqrt(limits.maxStorageBufferRange / 4.0)) : limits.maxImageDimension2D;
+        return edge > 2 * halo() ? edge - 2 * halo() : 0;
+    }
+
+    void reset_statistics() {
+        _timings.clear();
+        _pass_ms.clear();
+        _profiled = 0;
+    }
+
+    // folds what retired since the marks into one image, so the tiles of an image count once.
+    // the pass times are sums already, only the counts change
+    void merge_image(std::size_t timings, std::size_t profiled) {
+        if (_timings.size() > timings) {
+            const timing image{_timings[timings].submitted, _timings.back().retired};
+            _timings.resize(timings);
+            _timings.push_back(image);
+        }
+        _profiled = std::min(_profiled, profiled + 1);
+    }
+
+    std::string_view kernel_name() const {
+        return _kernel_name;
+    }
+
+    // average time of the kernel marker over the resolved slots
+    std::optional<double> kernel_ms() const {
+        for (const auto& r : _pass_ms) {
+            if (_profiled && (r.name == "sharpen" || r.name == "filter")) {
+                return r.ms / _profiled;
+            }
+        }
+        return std::nullopt;
+    }
 };
 
-int main(int argc, char** argv) {
+// the naive and tiled kernels are the sharpen preset
+std::vector<filter> cpu_filters(const options& opts) {
+    return opts.sharpen == kernel::convolve ? opts.filters : std::vector<filter>{filter::parse("sharpen")};
+}
+
+// an instance without layers that sees at least one physical device
+bool gpu_available() {
     try {
-        if (argc < 2) {
-            throw std::runtime_error("usage: headless /path/to/image");
-        }
+        vk::raii::Context context{};
+        vk::InstanceCreateInfo info{{}, &app_info};
+        vk::raii::Instance instance{context, info};
+        return !instance.enumeratePhysicalDevices().empty();
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+void print_gpu_times(const headless& headless) {
+    if (!headless._profiled) {
+        return;
+    }
+
+    std::string line{"gpu per image:"};
+    for (const auto& r : headless._pass_ms) {
+        line += fmt::format(" {} {:.3f}ms", r.name, r.ms / headless._profiled);
+    }
+    fmt::print("{}\n", line);
+}
+
+void print_memory(const vulkan::device& device) {
+    const auto mem = device.memory_statistics();
+    fmt::print("memory: {} blocks, {} allocations ({} dedicated), {}/{} KiB used, fragmentation {:.2f}\n",
+               mem.blocks, mem.allocations, mem.dedicated, mem.used / 1024, mem.reserved / 1024, mem.fragmentation);
+}
+
+void print_statistics(const image_statistics& stats) {
+    constexpr std::string_view names[] = {"r", "g", "b"};
+    for (std::size_t c = 0; c < stats.channels.size(); ++c) {
+        const auto& ch = stats.channels[c];
+        fmt::print("{}: min {} max {} mean {:.2f} stddev {:.2f} p1 {} p99 {}\n",
+                   names[c], ch.minimum, ch.maximum, ch.mean(), std::sqrt(std::max(ch.variance(), 0.0)), ch.percentile(0.01), ch.percentile(0.99));
+    }
+}
+
+std::uint32_t tile_edge(const options& opts, const headless& headless) {
+    return opts.tile ? opts.tile : std::min(2048u, headless.max_tile());
+}
+
+// streams the image through the slots in tiles of a fixed padded extent, so the device
+// memory does not depend on the image size. tiles overlap by the halo, pixels outside
+// the image are clamped like the kernels clamp them, and only the interior is stitched.
+// in stats-only mode the interior of every tile is reduced and merged into stats instead.
+// the tiles are recorded as one image in the timings, report prints the per-image line
+double run_tiled(headless& headless, const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width, std::uint32_t height, std::uint32_t tile, bool report, image_statistics* stats = nullptr) {
+    const auto halo = headless.halo();
+    const auto padded = tile + 2 * halo;
+    if (!headless.fits(padded, padded)) {
+        throw std::runtime_error(fmt::format("tiles can be at most {} pixels", headless.max_tile()));
+    }
+    headless.resize(padded, padded);
+
+    const auto timings = headless._timings.size();
+    const auto profiled = headless._profiled;
+    const auto start = clock_type::now();
+    std::uint32_t tiles{};
+    for (std::uint32_t ty = 0; ty < height; ty += tile) {
+        for (std::uint32_t tx = 0; tx < width; tx += tile) {
+            const auto fill = [=](std::uint8_t* input) {
+                for (std::uint32_t r = 0; r < padded; ++r) {
+                    const auto sy = std::clamp<std::int64_t>(std::int64_t{ty} + r - halo, 0, height - 1);
+                    const auto* row = src + sy * width * 4;
+                    auto* out = input + std::size_t{r} * padded * 4;
+
+                    // the columns inside the image in one go, the clamped ones around them pixel by pixel
+                    const auto x0 = std::int64_t{tx} - halo;
+                    const auto begin = std::clamp<std::int64_t>(x0, 0, width);
+                    const auto end = std::clamp<std::int64_t>(x0 + padded, 0, width);
+                    for (auto x = x0; x < begin; ++x) {
+                        std::memcpy(out + (x - x0) * 4, row, 4);
+                    }
+                    std::memcpy(out + (begin - x0) * 4, row + begin * 4, (end - begin) * 4);
+                    for (auto x = end; x < x0 + padded; ++x) {
+                        std::memcpy(out + (x - x0) * 4, row + (width - 1) * 4, 4);
+                    }
+                }
+            };
 
-        int w{}, h{}, c{}, wc{4};
-        auto data = stbi_load(argv[1], &w, &h, &c, wc);
-        if (!data) {
-            throw std::runtime_error("failed to load image");
+            const auto interior_w = std::min(tile, width - tx);
+            const auto interior_h = std::min(tile, height - ty);
+            const auto stitch = [=](const std::uint8_t* result) {
+                for (std::uint32_t r = 0; r < interior_h; ++r) {
+                    const auto* row = result + (std::size_t{r + halo} * padded + halo) * 4;
+                    std::memcpy(dst + (std::size_t{ty + r} * width + tx) * 4, row, std::size_t{interior_w} * 4);
+                }
+            };
+
+            if (stats) {
+                const vk::Rect2D interior{{std::int32_t(halo), std::int32_t(halo)}, {interior_w, interior_h}};
+                headless.submit_mapped(padded, padded, fill, [stats](const std::uint8_t* result) { stats->merge(image_statistics::read(result)); }, interior);
+            } else {
+                headless.submit_mapped(padded, padded, fill, stitch);
+            }
+            ++tiles;
         }
+    }
+    headless.flush();
+    headless.merge_image(timings, profiled);
 
-        std::uint32_t width = w;
-        std::uint32_t height = h;
-        headless headless{};
-        headless.resize(width, height);
+    const auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    if (report) {
+        fmt::print("{} kernel {}x{}, {}x{} image in {} tiles of {} (+{} halo), {} in flight: {:.2f}s, {:.1f} MPix/s\n",
+                   headless.kernel_name(), headless._workgroup.x, headless._workgroup.y, width, height, tiles, tile, halo,
+                   headless._slots.size(), seconds, width * double(height) / seconds / 1e6);
+    }
+
+    return 1.0 / seconds;
+}
 
-        std::vector<std::uint8_t> image_bytes(w * h * wc);
+// the same image over and over, reports pipelined throughput and latency.
+// stats-only mode leaves dst alone and stores the statistics of the last run in stats
+double run_repeated(headless& headless, const options& opts, const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width, std::uint32_t height, image_statistics* stats = nullptr) {
+    headless.resize(width, height);
 
-        for (int i = 0; i < 20; ++i) {
-            const auto now = std::chrono::steady_clock::now();
-            headless.process_image(data, image_bytes.data(), w, h);
-            const auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - now).count();
-            fmt::print("took {}ms\n", dur);
+    for (std::uint32_t i = 0; i < opts.iterations; ++i) {
+        if (stats) {
+            headless.submit_stats(src, width, height, [stats](const image_statistics& result) { *stats = result; });
+        } else {
+            headless.submit(src, dst, width, height);
         }
+    }
+    headless.flush();
 
+    // latency is taken from upload to readback of each image, throughput from
+    // the retire times once the pipeline is full
+    const auto& timings = headless._timings;
+    std::vector<double> latencies{};
+    for (const auto& t : timings) {
+        latencies.push_back(to_ms(t.retired - t.submitted));
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    const auto steady = std::min<std::size_t>(opts.inflight, timings.size() - 1);
+    const auto span = std::chrono::duration<double>(timings.back().retired - timings[steady].retired).count();
+    const auto count = timings.size() - 1 - steady;
+    const auto total = std::chrono::duration<double>(timings.back().retired - timings.front().submitted).count();
+    const auto throughput = count > 0 && span > 0 ? count / span : timings.size() / total;
+
+    fmt::print("{} kernel {}x{}, {} images, {} in flight: {:.1f} images/s, latency min {:.2f}ms median {:.2f}ms max {:.2f}ms\n",
+               headless.kernel_name(), headless._workgroup.x, headless._workgroup.y, timings.size(), opts.inflight, throughput, latencies.front(), latencies[latencies.size() / 2], latencies.back());
+
+    print_gpu_times(headless);
+
+    return throughput;
+}
+
+// the cpu backend on the same image, one run after the other
+double run_cpu(const options& opts, const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width, std::uint32_t height) {
+    const auto threads = opts.threads;
+    const auto filters = cpu_filters(opts);
+    cpu_filter cpu{filters, opts.separable, threads};
+
+    std::vector<double> latencies{};
+    for (std::uint32_t i = 0; i < opts.iterations; ++i) {
+        const auto start = clock_type::now();
+        cpu.run(src, dst, width, height);
+        latencies.push_back(to_ms(clock_type::now() - start));
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    const auto total = std::accumulate(latencies.begin(), latencies.end(), 0.0);
+    const auto throughput = latencies.size() * 1000.0 / total;
+    fmt::print("cpu {} ({}, {} threads), {} images: {:.1f} images/s, latency min {:.2f}ms median {:.2f}ms max {:.2f}ms\n",
+               kernel_name(opts.sharpen, filters, opts.separable, false, false), cpu_filter::isa(), threads, latencies.size(),
+               throughput, latencies.front(), latencies[latencies.size() / 2], latencies.back());
+
+    return throughput;
+}
+
+// the gpu result of one image, tiled when the device can not hold it at once
+double run_gpu(const options& opts, const std::uint8_t* src, std::uint8_t* dst, std::uint32_t width, std::uint32_t height, image_statistics* stats = nullptr) {
+    headless headless{opts};
+    const auto tiled = opts.tile || !headless.fits(width, height);
+    const auto throughput = tiled ? run_tiled(headless, src, dst, width, height, tile_edge(opts, headless), true, stats)
+                                  : run_repeated(headless, opts, src, dst, width, height, stats);
+
+    print_memory(headless._device);
+    headless.wait_idle();
+
+    return throughput;
+}
+
+// images the device can not hold at once are tiled, --tile tiles any image
+double run_benchmark(const options& opts, const std::filesystem::path& path) {
+    int w{}, h{}, c{}, wc{4};
+    auto data = stbi_load(path.string().c_str(), &w, &h, &c, wc);
+    if (!data) {
+        throw std::runtime_error("failed to load image");
+    }
+
+    std::uint32_t width = w;
+    std::uint32_t height = h;
+    std::vector<std::uint8_t> image_bytes(std::size_t{width} * height * wc);
+
+    // the cpu has the pixels anyway, its statistics are taken on the host
+    image_statistics stats{};
+    const auto stats_only = opts.stats_only && opts.engine != backend::cpu;
+    const auto throughput = opts.engine == backend::cpu ? run_cpu(opts, data, image_bytes.data(), width, height)
+                                                        : run_gpu(opts, data, image_bytes.data(), width, height, stats_only ? &stats : nullptr);
+
+    if (opts.stats_only) {
+        if (!stats_only) {
+            stats = image_statistics::of(image_bytes.data(), std::size_t{width} * height);
+        }
+        print_statistics(stats);
+    } else {
         stbi_write_jpg("headless.jpg", w, h, 4, image_bytes.data(), 90);
+    }
+    stbi_image_free(data);
+
+    return throughput;
+}
+
+// both data paths on the same image, one after the other
+void run_compare(const options& opts, const std::filesystem::path& path) {
+    auto image_opts = opts;
+    image_opts.path = data_path::image;
+    auto buffer_opts = opts;
+    buffer_opts.path = data_path::buffer;
+
+    const auto image = run_benchmark(image_opts, path);
+    const auto buffer = run_benchmark(buffer_opts, path);
+    fmt::print("buffer path: {:.2f}x the throughput of the image path\n", buffer / image);
+}
+
+// the tiled kernel in fp32 and fp16 on the same image, throughput and how far the results are apart
+void run_precision(const options& opts, const std::filesystem::path& path) {
+    int w{}, h{}, c{}, wc{4};
+    std::unique_ptr<stbi_uc, void (*)(void*)> data{stbi_load(path.string().c_str(), &w, &h, &c, wc), stbi_image_free};
+    if (!data) {
+        throw std::runtime_error("failed to load image");
+    }
+
+    std::uint32_t width = w;
+    std::uint32_t height = h;
+    std::vector<std::uint8_t> full_bytes(std::size_t{width} * height * wc);
+    std::vector<std::uint8_t> half_bytes(full_bytes.size());
+
+    auto full_opts = opts;
+    full_opts.arithmetic = precision::fp32;
+    auto half_opts = opts;
+    half_opts.arithmetic = precision::fp16;
+
+    const auto full = run_gpu(full_opts, data.get(), full_bytes.data(), width, height);
+    const auto half = run_gpu(half_opts, data.get(), half_bytes.data(), width, height);
+
+    int max_diff{};
+    double sum_diff{};
+    for (std::size_t i = 0; i < full_bytes.size(); ++i) {
+        const auto diff = std::abs(int{full_bytes[i]} - int{half_bytes[i]});
+        max_diff = std::max(max_diff, diff);
+        sum_diff += diff;
+    }
+
+    fmt::print("fp16: {:.2f}x the throughput of fp32, max difference {}, mean difference {:.4f}\n",
+               half / full, max_diff, sum_diff / full_bytes.size());
+}
+
+// both backends on the same image, every channel has to agree within the tolerance
+bool run_parity(const options& opts, const std::filesystem::path& path) {
+    int w{}, h{}, c{}, wc{4};
+    std::unique_ptr<stbi_uc, void (*)(void*)> data{stbi_load(path.string().c_str(), &w, &h, &c, wc), stbi_image_free};
+    if (!data) {
+        throw std::runtime_error("failed to load image");
+    }
+
+    std::uint32_t width = w;
+    std::uint32_t height = h;
+    std::vector<std::uint8_t> gpu_bytes(std::size_t{width} * height * wc);
+    std::vector<std::uint8_t> cpu_bytes(gpu_bytes.size());
 
-        headless.wait_idle();
+    const auto gpu = run_gpu(opts, data.get(), gpu_bytes.data(), width, height);
+    const auto cpu = run_cpu(opts, data.get(), cpu_bytes.data(), width, height);
+
+    // the naive kernel reads outside the image on the border instead of clamping
+    const auto skip = opts.sharpen == kernel::naive ? 1u : 0u;
+
+    int max_diff{};
+    std::size_t over{}, compared{};
+    for (auto y = skip; y + skip < height; ++y) {
+        for (auto x = skip; x + skip < width; ++x) {
+            for (std::uint32_t ch = 0; ch < 4; ++ch) {
+                const auto i = (std::size_t{y} * width + x) * 4 + ch;
+                const auto diff = std::abs(int{gpu_bytes[i]} - int{cpu_bytes[i]});
+                max_diff = std::max(max_diff, diff);
+                over += diff > int(opts.tolerance);
+                ++compared;
+            }
+        }
+    }
+
+    fmt::print("parity: max difference {}, {} of {} channels above {} ({:.4f}%)\n",
+               max_diff, over, compared, opts.tolerance, compared ? 100.0 * over / compared : 0.0);
+    fmt::print("cpu backend: {:.2f}x the throughput of the gpu backend\n", cpu / gpu);
+
+    return over == 0;
+}
+
+// times every candidate workgroup size on one image and caches the fastest for this device
+void run_autotune(const options& opts, const std::filesystem::path& path) {
+    int w{}, h{}, c{}, wc{4};
+    std::unique_ptr<stbi_uc, void (*)(void*)> data{stbi_load(path.string().c_str(), &w, &h, &c, wc), stbi_image_free};
+    if (!data) {
+        throw std::runtime_error("failed to load image");
+    }
+
+    headless headless{opts};
+    headless.resize(w, h);
+    std::vector<std::uint8_t> image_bytes(w * h * wc);
+
+    const auto candidates = vulkan::workgroup_candidates(headless._device, [&](vulkan::workgroup_size size) {
+        return headless.shared_bytes(size);
+    });
+    if (candidates.empty()) {
+        throw std::runtime_error("no workgroup size fits the device limits");
+    }
+
+    // the kernel marker when timestamps are supported, the whole round-trip otherwise
+    std::optional<vulkan::workgroup_size> best{};
+    double best_ms{};
+    for (const auto size : candidates) {
+        headless.set_workgroup(size);
+        headless.submit(data.get(), image_bytes.data(), w, h);
+        headless.flush();
+        headless.reset_statistics();
+
+        const auto start = clock_type::now();
+        for (std::uint32_t i = 0; i < opts.iterations; ++i) {
+            headless.submit(data.get(), image_bytes.data(), w, h);
+        }
+        headless.flush();
+
+        const auto ms = headless.kernel_ms().value_or(to_ms(clock_type::now() - start) / opts.iterations);
+        fmt::print("  {}x{}: {:.3f}ms\n", size.x, size.y, ms);
+
+        if (!best || ms < best_ms) {
+            best = size;
+            best_ms = ms;
+        }
+    }
+
+    vulkan::workgroup_cache{headless._device, opts.tune_cache}.store(headless.kernel_name(), *best);
+    fmt::print("{} kernel: {}x{} is fastest at {:.3f}ms, stored in {}\n", headless.kernel_name(), best->x, best->y, best_ms, opts.tune_cache.string());
+
+    headless.wait_idle();
+}
+
+struct stbi_deleter {
+    void operator()(stbi_uc* p) const {
+        stbi_image_free(p);
+    }
+};
+
+struct job {
+    std::filesystem::path path;
+    std::filesystem::path output;
+    std::unique_ptr<stbi_uc, stbi_deleter> pixels;
+    std::vector<std::uint8_t> result;
+    image_statistics stats{};
+    int width{};
+    int height{};
+    double decode_ms{};
+    double encode_ms{};
+    bool failed{false};
+};
+
+// decoding and encoding run on worker threads, the main thread only feeds
+// the gpu slots, so both are hidden behind gpu work as long as the workers keep up
+void run_batch(const options& opts, const std::vector<std::filesystem::path>& files) {
+    std::filesystem::create_directories(opts.output);
+
+    std::optional<headless> gpu{};
+    std::optional<cpu_filter> cpu{};
+    if (opts.engine == backend::cpu) {
+        cpu.emplace(cpu_filters(opts), opts.separable, opts.threads);
+    } else {
+        gpu.emplace(opts);
+    }
+    // filter time summed per image, cpu runs are timed here and gpu ones from submit to retire
+    double filter_ms{};
+    std::size_t filtered{};
+
+    const auto outputs = output_names(opts.output, files);
+    std::vector<std::unique_ptr<job>> jobs{};
+    common::bounded_queue<std::unique_ptr<job>> decoded{opts.inflight * 2};
+
+    const auto decoders = std::max<std::uint32_t>(opts.threads / 2, 1);
+    const auto encoders = std::max<std::uint32_t>(opts.threads - decoders, 1);
+    common::thread_pool decode_pool{decoders};
+    common::thread_pool encode_pool{encoders, opts.inflight * 2};
+
+    // unblocks the decoders should the gpu loop throw
+    struct close_guard {
+        common::bounded_queue<std::unique_ptr<job>>& queue;
+        ~close_guard() {
+            queue.close();
+        }
+    } guard{decoded};
+
+    const auto start = clock_type::now();
+
+    std::atomic<std::size_t> next{};
+    for (std::uint32_t t = 0; t < decoders; ++t) {
+        decode_pool.submit([&] {
+            for (auto i = next++; i < files.size(); i = next++) {
+                auto j = std::make_unique<job>();
+                j->path = files[i];
+                j->output = outputs[i];
+
+                const auto begin = clock_type::now();
+                int c{};
+                j->pixels.reset(stbi_load(j->path.string().c_str(), &j->width, &j->height, &c, 4));
+                j->decode_ms = to_ms(clock_type::now() - begin);
+
+                if (!decoded.push(std::move(j))) {
+                    return;
+                }
+            }
+        });
+    }
+
+    double starved_ms{};
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        const auto wait = clock_type::now();
+        auto j = decoded.pop();
+        starved_ms += to_ms(clock_type::now() - wait);
+        if (!j) {
+            break;
+        }
+
+        auto& item = *jobs.emplace_back(std::move(*j));
+        if (!item.pixels) {
+            fmt::print("failed to load {}\n", item.path.string());
+            item.failed = true;
+            continue;
+        }
+
+        const auto encode = [&item, &encode_pool] {
+            encode_pool.submit([&item] {
+                const auto begin = clock_type::now();
+                item.failed = !stbi_write_jpg(item.output.string().c_str(), item.width, item.height, 4, item.result.data(), 90);
+                item.result = {};
+                item.encode_ms = to_ms(clock_type::now() - begin);
+            });
+        };
+
+        // only the statistics come back from the gpu, nothing is encoded
+        if (gpu && opts.stats_only) {
+            if (opts.tile || !gpu->fits(item.width, item.height)) {
+                run_tiled(*gpu, item.pixels.get(), nullptr, item.width, item.height, tile_edge(opts, *gpu), false, &item.stats);
+            } else {
+                gpu->submit_stats(item.pixels.get(), item.width, item.height, [&item](const image_statistics& stats) { item.stats = stats; });
+            }
+            item.pixels.reset();
+            continue;
+        }
+
+        // oversized images are streamed in tiles right away, the slots are resized back afterwards
+        item.result.resize(static_cast<std::size_t>(item.width) * item.height * 4);
+        if (cpu) {
+            const auto begin = clock_type::now();
+            cpu->run(item.pixels.get(), item.result.data(), item.width, item.height);
+            filter_ms += to_ms(clock_type::now() - begin);
+            ++filtered;
+            if (opts.stats_only) {
+                item.stats = image_statistics::of(item.result.data(), item.result.size() / 4);
+                item.result = {};
+            } else {
+                encode();
+            }
+        } else if (opts.tile || !gpu->fits(item.width, item.height)) {
+            run_tiled(*gpu, item.pixels.get(), item.result.data(), item.width, item.height, tile_edge(opts, *gpu), false);
+            encode();
+        } else {
+            gpu->submit(item.pixels.get(), item.result.data(), item.width, item.height, encode);
+        }
+        item.pixels.reset();
+    }
+
+    if (gpu) {
+        gpu->flush();
+    }
+    decode_pool.wait();
+    encode_pool.wait();
+
+    const auto total = std::chrono::duration<double>(clock_type::now() - start).count();
+
+    double decode_ms{};
+    double encode_ms{};
+    std::size_t failed{};
+    for (const auto& j : jobs) {
+        decode_ms += j->decode_ms;
+        encode_ms += j->encode_ms;
+        failed += j->failed;
+    }
+
+    if (gpu) {
+        for (const auto& t : gpu->_timings) {
+            filter_ms += to_ms(t.retired - t.submitted);
+        }
+        filtered += gpu->_timings.size();
+    }
+
+    // one row per image and channel, for auto levels and quality checks downstream
+    if (opts.stats_only) {
+        const auto csv = opts.output / "stats.csv";
+        std::ofstream out{csv, std::ios::trunc};
+        out << "image,channel,min,max,mean,stddev,p1,p99\n";
+        for (const auto& j : jobs) {
+            for (std::size_t c = 0; c < j->stats.channels.size() && !j->failed; ++c) {
+                const auto& ch = j->stats.channels[c];
+                out << fmt::format("{},{},{},{},{:.3f},{:.3f},{},{}\n", j->path.filename().string(), "rgb"[c], ch.minimum, ch.maximum,
+                                   ch.mean(), std::sqrt(std::max(ch.variance(), 0.0)), ch.percentile(0.01), ch.percentile(0.99));
+            }
+        }
+        fmt::print("statistics of {} images written to {}\n", jobs.size() - failed, csv.string());
+    }
+
+    const auto done = jobs.size() - failed;
+    const auto per_image = [](double ms, std::size_t n) { return n ? ms / n : 0.0; };
+
+    fmt::print("{} images ({} failed) in {:.2f}s: {:.1f} images/s, {} decode / {} encode threads, {} in flight\n",
+               done, failed, total, done / total, decoders, encoders, opts.inflight);
+    const auto name = gpu ? "gpu" : "cpu";
+    fmt::print("per image: decode {:.2f}ms, {} {:.2f}ms, encode {:.2f}ms, {} waited {:.1f}ms for decoded images\n",
+               per_image(decode_ms, jobs.size()), name, per_image(filter_ms, filtered), per_image(encode_ms, done), name, starved_ms);
+
+    if (gpu) {
+        print_gpu_times(*gpu);
+        print_memory(gpu->_device);
+        gpu->wait_idle();
+    }
+}
+
+int main(int argc, char** argv) {
+    try {
+        auto opts = parse_options(argc, argv);
+        if (opts.engine == backend::automatic) {
+            opts.engine = gpu_available() ? backend::gpu : backend::cpu;
+            if (opts.engine == backend::cpu) {
+                fmt::print("no vulkan device, using the cpu backend\n");
+            }
+        }
+
+        const auto files = collect_images(opts.inputs);
+        const auto single = opts.inputs.size() == 1 && !std::filesystem::is_directory(opts.inputs.front());
+        if (opts.path == data_path::compare && !single) {
+            throw std::runtime_error("compare needs a single image");
+        }
+        if ((opts.parity || opts.arithmetic == precision::compare) && !single) {
+            throw std::runtime_error("parity and precision compare need a single image");
+        }
+        if (opts.engine == backend::cpu && (opts.parity || opts.autotune || opts.path == data_path::compare || opts.arithmetic == precision::compare)) {
+            throw std::runtime_error("parity, autotune and compare need a vulkan device");
+        }
+
+        if (opts.autotune && !files.empty()) {
+            for (const auto path : {data_path::image, data_path::buffer}) {
+                if (opts.path == path || opts.path == data_path::compare) {
+                    auto tune_opts = opts;
+                    tune_opts.path = path;
+                    run_autotune(tune_opts, files.front());
+                }
+            }
+        }
+
+        // a single image keeps the old benchmark behaviour
+        if (opts.parity) {
+            if (!run_parity(opts, files.front())) {
+                fmt::print("error: the backends disagree by more than {}\n", opts.tolerance);
+                return 1;
+            }
+        } else if (opts.arithmetic == precision::compare) {
+            run_precision(opts, files.front());
+        } else if (single && opts.path == data_path::compare) {
+            run_compare(opts, files.front());
+        } else if (single) {
+            run_benchmark(opts, files.front());
+        } else {
+            run_batch(opts, files);
+        }
 
     } catch (const std::exception& ex) {
         fmt::print("error: {}\n", ex.what());
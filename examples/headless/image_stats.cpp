@@ -0,0 +1,149 @@
+#include "image_stats.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#include <stats.comp.hpp>
+#include <stats_subgroup.comp.hpp>
+
+namespace {
+
+// the std430 layout of the Stats block in stats.comp
+struct stats_layout {
+    std::uint32_t histogram[3][256];
+    std::uint32_t minimum[3];
+    std::uint32_t maximum[3];
+    std::uint32_t sum[3][2];
+    std::uint32_t squares[3][2];
+};
+
+std::uint64_t join(const std::uint32_t (&words)[2]) {
+    return std::uint64_t{words[1]} << 32 | words[0];
+}
+
+} // namespace
+
+std::uint64_t image_statistics::channel::count() const {
+    std::uint64_t n{};
+    for (const auto h : histogram) {
+        n += h;
+    }
+    return n;
+}
+
+double image_statistics::channel::mean() const {
+    const auto n = count();
+    return n ? double(sum) / n : 0.0;
+}
+
+double image_statistics::channel::variance() const {
+    const auto n = count();
+    if (!n) {
+        return 0.0;
+    }
+    const auto m = mean();
+    return double(squares) / n - m * m;
+}
+
+std::uint32_t image_statistics::channel::percentile(double fraction) const {
+    const auto target = fraction * count();
+    std::uint64_t seen{};
+    for (std::uint32_t v = 0; v < histogram.size(); ++v) {
+        seen += histogram[v];
+        if (seen && seen >= target) {
+            return v;
+        }
+    }
+    return maximum;
+}
+
+image_statistics image_statistics::read(const std::uint8_t* mapped) {
+    stats_layout raw{};
+    std::memcpy(&raw, mapped, sizeof(raw));
+
+    image_statistics stats{};
+    for (std::size_t c = 0; c < 3; ++c) {
+        auto& ch = stats.channels[c];
+        std::memcpy(ch.histogram.data(), raw.histogram[c], sizeof(raw.histogram[c]));
+        ch.minimum = raw.minimum[c];
+        ch.maximum = raw.maximum[c];
+        ch.sum = join(raw.sum[c]);
+        ch.squares = join(raw.squares[c]);
+    }
+    return stats;
+}
+
+image_statistics image_statistics::of(const std::uint8_t* rgba, std::size_t pixels) {
+    image_statistics stats{};
+    for (std::size_t i = 0; i < pixels; ++i) {
+        for (std::size_t c = 0; c < 3; ++c) {
+            const std::uint32_t v = rgba[i * 4 + c];
+            auto& ch = stats.channels[c];
+            ++ch.histogram[v];
+            ch.minimum = std::min(ch.minimum, v);
+            ch.maximum = std::max(ch.maximum, v);
+            ch.sum += v;
+            ch.squares += v * v;
+        }
+    }
+    return stats;
+}
+
+void image_statistics::merge(const image_statistics& other) {
+    for (std::size_t c = 0; c < 3; ++c) {
+        auto& ch = channels[c];
+        const auto& o = other.channels[c];
+        for (std::size_t i = 0; i < ch.histogram.size(); ++i) {
+            ch.histogram[i] += o.histogram[i];
+        }
+        ch.minimum = std::min(ch.minimum, o.minimum);
+        ch.maximum = std::max(ch.maximum, o.maximum);
+        ch.sum += o.sum;
+        ch.squares += o.squares;
+    }
+}
+
+vk::DeviceSize image_stats::buffer_size() {
+    return sizeof(stats_layout);
+}
+
+bool image_stats::subgroup_arithmetic(const vulkan::device& dev) {
+    const auto chain = dev.physical().getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+    const auto& props = chain.get<vk::PhysicalDeviceSubgroupProperties>();
+    return (props.supportedStages & vk::ShaderStageFlagBits::eCompute) && (props.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic);
+}
+
+image_stats::image_stats(const vulkan::device& dev, const vk::PipelineLayout& layout)
+    : _subgroups(subgroup_arithmetic(dev)) {
+    const auto shader = _subgroups ? dev.make_shader_module({{}, stats_subgroup_comp::size, stats_subgroup_comp::code})
+                                   : dev.make_shader_module({{}, stats_comp::size, stats_comp::code});
+    const vulkan::workgroup_specialization specialization{_workgroup};
+    vk::PipelineShaderStageCreateInfo pssci{{}, vk::ShaderStageFlagBits::eCompute, *shader, "main", specialization.info()};
+    _pipeline = dev.make_pipeline(vk::ComputePipelineCreateInfo{{}, pssci, layout});
+}
+
+bool image_stats::subgroups() const {
+    return _subgroups;
+}
+
+void image_stats::record(const vk::CommandBuffer& cb, const vk::PipelineLayout& layout, const vk::Buffer& buffer, vk::Rect2D region) const {
+    // everything starts at zero except the minimums, the fills do not overlap so they need no barrier
+    constexpr auto minimum = offsetof(stats_layout, minimum);
+    constexpr auto maximum = offsetof(stats_layout, maximum);
+    cb.fillBuffer(buffer, 0, minimum, 0);
+    cb.fillBuffer(buffer, minimum, maximum - minimum, 0xffffffff);
+    cb.fillBuffer(buffer, maximum, buffer_size() - maximum, 0);
+
+    vk::MemoryBarrier clear_barrier{vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite};
+    cb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, clear_barrier, nullptr, nullptr);
+
+    const push_constants pc{region.offset.x, region.offset.y, region.extent.width, region.extent.height};
+    cb.pushConstants(layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(pc), &pc);
+    cb.bindPipeline(vk::PipelineBindPoint::eCompute, *_pipeline);
+
+    // every invocation covers four rows, see rowsPerInvocation
+    constexpr std::uint32_t rows_per_invocation = 4;
+    const auto rows = (region.extent.height + rows_per_invocation - 1) / rows_per_invocation;
+    cb.dispatch(_workgroup.groups_x(region.extent.width), _workgroup.groups_y(rows), 1);
+}
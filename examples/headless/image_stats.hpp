@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vulkan.hpp"
+#include "workgroup.hpp"
+
+#include <array>
+#include <cstdint>
+
+// rgb statistics of an rgba8 image, alpha is ignored
+struct image_statistics {
+    struct channel {
+        std::array<std::uint32_t, 256> histogram{};
+        std::uint32_t minimum{255};
+        std::uint32_t maximum{0};
+        std::uint64_t sum{};
+        std::uint64_t squares{};
+
+        std::uint64_t count() const;
+        double mean() const;
+        double variance() const;
+        // the smallest value with at least fraction of the pixels at or below it
+        std::uint32_t percentile(double fraction) const;
+    };
+
+    std::array<channel, 3> channels{};
+
+    // decodes the buffer the kernels reduce into
+    static image_statistics read(const std::uint8_t* mapped);
+    // the same on the host, for results that are already in memory
+    static image_statistics of(const std::uint8_t* rgba, std::size_t pixels);
+
+    // adds the pixels of another part of the same image, e.g. the next tile
+    void merge(const image_statistics& other);
+};
+
+// reduces a region of the image bound at binding 1 into the buffer at binding 6.
+// with subgroup arithmetic each subgroup is reduced in registers before the shared
+// memory atomics, without it every invocation hits the shared counters
+class image_stats {
+    bool _subgroups{false};
+    vulkan::workgroup_size _workgroup{};
+    vk::raii::Pipeline _pipeline{nullptr};
+
+  public:
+    struct push_constants {
+        std::int32_t x;
+        std::int32_t y;
+        std::uint32_t width;
+        std::uint32_t height;
+    };
+
+    static constexpr vk::PushConstantRange push_range() {
+        return {vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants)};
+    }
+
+    // what the host reads back per image, a few KiB whatever the image size
+    static vk::DeviceSize buffer_size();
+
+    // subgroup min, max and add in compute shaders
+    static bool subgroup_arithmetic(const vulkan::device& dev);
+
+    image_stats() = default;
+    image_stats(const vulkan::device& dev, const vk::PipelineLayout& layout);
+
+    bool subgroups() const;
+
+    // clears the buffer and reduces the region into it. the caller orders the
+    // writes to the image before and the reads of the buffer after it
+    void record(const vk::CommandBuffer& cb, const vk::PipelineLayout& layout, const vk::Buffer& buffer, vk::Rect2D region) const;
+};
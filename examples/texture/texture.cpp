@@ -1,4 +1,7 @@
 #include "application.hpp"
+#include "transfer.hpp"
+
+#include <algorithm>
 
 #include <fmt/core.h>
 
@@ -36,7 +39,7 @@ struct uniform {
     glm::mat4 p;
 
     static constexpr vk::DescriptorSetLayoutBinding layout_binding() {
-        return {0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex};
+        return {0, vk::DescriptorType::eUniformBufferDynamic, 1, vk::ShaderStageFlagBits::eVertex};
     }
 };
 
@@ -46,23 +49,31 @@ struct texture : public common::application<texture> {
 
     vulkan::device_buffer _verticies_buffer;
     vulkan::device_buffer _indices_buffer;
-    vulkan::host_buffer _uniform_buffer;
     vulkan::texture _texture;
 
     vk::raii::DescriptorSetLayout _descriptor_layout{nullptr};
     vk::raii::DescriptorPool _descriptor_pool{nullptr};
     vk::raii::DescriptorSet _descriptor_set{nullptr};
 
-    texture() : common::application<texture>({"texture", 1, "engine", 1, VK_API_VERSION_1_0}, 800, 600) {
-        make_vertex_buffer();
-        make_indices_buffer();
-        make_texture_image();
-
-        _uniform_buffer = {
-            _device,
-            sizeof(uniform),
-            vk::BufferUsageFlagBits::eUniformBuffer,
-        };
+    texture(bool batched, const common::application_config& config)
+        : common::application<texture>({"texture", 1, "engine", 1, VK_API_VERSION_1_1}, 800, 600, config) {
+        const auto start = std::chrono::steady_clock::now();
+        {
+            // unbatched mode waits for every upload the way the per-call helpers did
+            vulkan::upload_batch batch{_device, _ring};
+            make_vertex_buffer(batch);
+            if (!batched) {
+                batch.submit().wait();
+            }
+            make_indices_buffer(batch);
+            if (!batched) {
+                batch.submit().wait();
+            }
+            make_texture_image(batch);
+            batch.submit().wait();
+        }
+        const auto dur = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        fmt::print("{} uploads took {:.2f}ms\n", batched ? "batched" : "unbatched", dur);
 
         vk::DescriptorSetLayoutBinding bindings[] = {
             uniform::layout_binding(),
@@ -73,7 +84,7 @@ struct texture : public common::application<texture> {
         _descriptor_layout = _device.make_descriptor_set_layout(dslci);
 
         vk::DescriptorPoolSize sizes[] = {
-            {vk::DescriptorType::eUniformBuffer, 1},
+            {vk::DescriptorType::eUniformBufferDynamic, 1},
             {vk::DescriptorType::eCombinedImageSampler, 1},
         };
 
@@ -83,10 +94,10 @@ struct texture : public common::application<texture> {
         vk::DescriptorSetAllocateInfo dsai{_descriptor_pool, *_descriptor_layout};
         _descriptor_set = std::move(_device.make_descriptor_sets(dsai).front());
 
-        vk::DescriptorBufferInfo dbi{_uniform_buffer.buf(), 0, sizeof(uniform)};
+        vk::DescriptorBufferInfo dbi{_ring.buf(), 0, sizeof(uniform)};
         vk::DescriptorImageInfo dii{_texture.sampler(), _texture.view(), vk::ImageLayout::eShaderReadOnlyOptimal};
         vk::WriteDescriptorSet wdss[] = {
-            {_descriptor_set, 0, 0, vk::DescriptorType::eUniformBuffer, {}, dbi},
+            {_descriptor_set, 0, 0, vk::DescriptorType::eUniformBufferDynamic, {}, dbi},
             {_descriptor_set, 1, 0, vk::DescriptorType::eCombinedImageSampler, dii},
         };
         _device.logical().updateDescriptorSets(wdss, nullptr);
@@ -114,7 +125,7 @@ struct texture : public common::application<texture> {
         _pipeline = _device.make_pipeline(pci);
     }
 
-    void make_vertex_buffer() {
+    void make_vertex_buffer(vulkan::upload_batch& batch) {
         std::array<vertex, 24> verticies = {{
             // front
             {{-0.5, +0.5, +0.5}, {1.0, 0.0, 0.0}, {0.0, 1.0}},
@@ -154,23 +165,16 @@ struct texture : public common::application<texture> {
         }};
 
         constexpr auto size = sizeof(vertex) * verticies.size();
-        vulkan::host_buffer staging{
-            _device,
-            size,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            verticies.data(),
-        };
-
         _verticies_buffer = {
             _device,
             size,
             vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
         };
 
-        _device.copy_buffers(staging.buf(), _verticies_buffer.buf(), size);
+        batch.upload(_verticies_buffer, verticies.data(), size);
     }
 
-    void make_indices_buffer() {
+    void make_indices_buffer(vulkan::upload_batch& batch) {
         // clang-format off
         std::array<std::uint32_t, 36> indicies = {
             0, 1, 2, 2, 3, 0, 
@@ -183,23 +187,16 @@ struct texture : public common::application<texture> {
         // clang-format on
 
         constexpr auto size = sizeof(std::uint32_t) * indicies.size();
-        vulkan::host_buffer staging{
-            _device,
-            size,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            indicies.data(),
-        };
-
         _indices_buffer = {
             _device,
             size,
             vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
         };
 
-        _device.copy_buffers(staging.buf(), _indices_buffer.buf(), size);
+        batch.upload(_indices_buffer, indicies.data(), size);
     }
 
-    void make_texture_image() {
+    void make_texture_image(vulkan::upload_batch& batch) {
         int w{}, h{}, c{}, wc{4};
         auto data = stbi_load("textures/vulkan.png", &w, &h, &c, wc);
         if (!data) {
@@ -209,21 +206,13 @@ struct texture : public common::application<texture> {
         std::uint32_t width = w;
         std::uint32_t height = h;
 
-        const vk::DeviceSize size = w * h * wc;
-        vulkan::host_buffer staging{
-            _device,
-            size,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            data,
-        };
-
         _texture = {_device, width, height};
 
-        _device.copy_buffer_to_image(staging.buf(), _texture.image(), _texture.extent(), vk::ImageLayout::eShaderReadOnlyOptimal);
+        batch.upload(_texture, data, vk::ImageLayout::eShaderReadOnlyOptimal);
     }
 
     void record(std::uint32_t i) {
-        const auto& cb = _frames[_current_frame].command_buffer;
+        const auto& cb = _frames[_current_frame].context.command_buffer();
         const auto [w, h] = _swapchain.extent();
         const auto time = current_time();
 
@@ -232,7 +221,7 @@ struct texture : public common::application<texture> {
             glm::lookAt(glm::vec3(1.0f, 2.0f, 4.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
             glm::perspective(glm::radians(45.0f), (float)w / h, 1.0f, 10.0f),
         };
-        _uniform_buffer.copy(&ubo, sizeof(ubo));
+        const auto ubo_range = _ring.push(&ubo, sizeof(ubo)).value();
 
         vk::ClearValue clear_values[] = {
             vk::ClearColorValue{0.5f, 0.5f, 0.5f, 1.0f},
@@ -241,24 +230,28 @@ struct texture : public common::application<texture> {
         vk::RenderPassBeginInfo rpbi{_render_pass, _framebuffers[i], {{0, 0}, _swapchain.extent()}, clear_values};
         vk::Viewport viewport{0.0f, 0.0f, (float)w, (float)h, 0.0f, 1.0f};
 
-        cb.reset();
         cb.begin({});
+        _profiler.reset(*cb, _current_frame);
+
+        const auto pass = _profiler.begin(*cb, "render pass");
         cb.beginRenderPass(rpbi, vk::SubpassContents::eInline);
         cb.bindPipeline(vk::PipelineBindPoint::eGraphics, _pipeline);
-        cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipeline_layout, 0, {_descriptor_set}, nullptr);
+        cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipeline_layout, 0, {_descriptor_set}, ubo_range.dynamic_offset());
         cb.bindVertexBuffers(0, _verticies_buffer.buf(), {0});
         cb.bindIndexBuffer(_indices_buffer.buf(), 0, vk::IndexType::eUint32);
         cb.setViewport(0, viewport);
         cb.setScissor(0, vk::Rect2D{{0, 0}, _swapchain.extent()});
         cb.drawIndexed(36, 1, 0, 0, 0);
         cb.endRenderPass();
+        _profiler.end(*cb, pass);
         cb.end();
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
     try {
-        texture text{};
+        const bool batched = std::none_of(argv + 1, argv + argc, [](const char* arg) { return std::string_view{arg} == "--unbatched"; });
+        texture text{batched, common::application_config::parse(argc, argv)};
 
         text.run();
 
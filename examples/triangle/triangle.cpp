@@ -1,4 +1,10 @@
 #include "application.hpp"
+#include "transfer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <string_view>
+#include <thread>
 
 #include <fmt/core.h>
 
@@ -41,21 +47,27 @@ struct triangle : public common::application<triangle> {
 
     vulkan::device_buffer _verticies_buffer;
     vulkan::device_buffer _indices_buffer;
-    vulkan::host_buffer _uniform_buffer;
 
+    // the set comes from the frame's arena and points at the frame's copy of the uniforms
     vk::raii::DescriptorSetLayout _descriptor_layout{nullptr};
-    vk::raii::DescriptorPool _descriptor_pool{nullptr};
-    vk::raii::DescriptorSet _descriptor_set{nullptr};
-
-    triangle() : common::application<triangle>({"triangle", 1, "engine", 1, VK_API_VERSION_1_0}, 800, 600) {
-        make_vertex_buffer();
-        make_indices_buffer();
 
-        _uniform_buffer = {
-            _device,
-            sizeof(uniform),
-            vk::BufferUsageFlagBits::eUniformBuffer,
-        };
+    // triangles laid out on a square grid, each one its own draw call
+    std::size_t _draws{1};
+
+    triangle(bool batched, std::size_t draws, const common::application_config& config)
+        : common::application<triangle>({"triangle", 1, "engine", 1, VK_API_VERSION_1_1}, 800, 600, config), _draws(std::max<std::size_t>(draws, 1)) {
+        const auto start = std::chrono::steady_clock::now();
+        {
+            vulkan::upload_batch batch{_device, _ring};
+            make_vertex_buffer(batch);
+            if (!batched) {
+                batch.submit().wait();
+            }
+            make_indices_buffer(batch);
+            batch.submit().wait();
+        }
+        const auto dur = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        fmt::print("{} uploads took {:.2f}ms\n", batched ? "batched" : "unbatched", dur);
 
         vk::DescriptorSetLayoutBinding bindings[] = {
             uniform::layout_binding(),
@@ -64,22 +76,6 @@ struct triangle : public common::application<triangle> {
         vk::DescriptorSetLayoutCreateInfo dslci{{}, bindings};
         _descriptor_layout = _device.make_descriptor_set_layout(dslci);
 
-        vk::DescriptorPoolSize sizes[] = {
-            {vk::DescriptorType::eUniformBuffer, 1},
-        };
-
-        vk::DescriptorPoolCreateInfo dpci{vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 1, sizes};
-        _descriptor_pool = _device.make_descriptor_pool(dpci);
-
-        vk::DescriptorSetAllocateInfo dsai{_descriptor_pool, *_descriptor_layout};
-        _descriptor_set = std::move(_device.make_descriptor_sets(dsai).front());
-
-        vk::DescriptorBufferInfo dbi{_uniform_buffer.buf(), 0, sizeof(uniform)};
-        vk::WriteDescriptorSet wdss[] = {
-            {_descriptor_set, 0, 0, vk::DescriptorType::eUniformBuffer, {}, dbi},
-        };
-        _device.logical().updateDescriptorSets(wdss, nullptr);
-
         const auto vert_shader = _device.make_shader_module({{}, triangle_vert::size, triangle_vert::code});
         const auto frag_shader = _device.make_shader_module({{}, triangle_frag::size, triangle_frag::code});
 
@@ -91,7 +87,8 @@ struct triangle : public common::application<triangle> {
         constexpr auto binding_desc = vertex::binding_desc();
         constexpr auto attribute_desc = vertex::attribute_desc();
         vk::PipelineVertexInputStateCreateInfo vertex_input_state{{}, binding_desc, attribute_desc};
-        vk::PipelineLayoutCreateInfo plci{{}, *_descriptor_layout};
+        vk::PushConstantRange push_range{vk::ShaderStageFlagBits::eVertex, 0, sizeof(glm::vec4)};
+        vk::PipelineLayoutCreateInfo plci{{}, *_descriptor_layout, push_range};
         _pipeline_layout = _device.make_pipeline_layout(plci);
 
         vk::GraphicsPipelineCreateInfo pci = default_pipeline_info{};
@@ -102,7 +99,7 @@ struct triangle : public common::application<triangle> {
         _pipeline = _device.make_pipeline(pci);
     }
 
-    void make_vertex_buffer() {
+    void make_vertex_buffer(vulkan::upload_batch& batch) {
         std::array<vertex, 3> verticies = {{
             {{+0.0, +0.5}, {1.0, 0.0, 0.0}},
             {{+0.5, -0.5}, {0.0, 1.0, 0.0}},
@@ -110,85 +107,178 @@ struct triangle : public common::application<triangle> {
         }};
 
         constexpr auto size = sizeof(vertex) * verticies.size();
-        vulkan::host_buffer staging{
-            _device,
-            size,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            verticies.data(),
-        };
-
         _verticies_buffer = {
             _device,
             size,
             vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
         };
 
-        _device.copy_buffers(staging.buf(), _verticies_buffer.buf(), size);
+        batch.upload(_verticies_buffer, verticies.data(), size);
     }
 
-    void make_indices_buffer() {
+    void make_indices_buffer(vulkan::upload_batch& batch) {
         std::array<std::uint32_t, 3> indicies = {0, 1, 2};
 
         constexpr auto size = sizeof(std::uint32_t) * indicies.size();
-        vulkan::host_buffer staging{
-            _device,
-            size,
-            vk::BufferUsageFlagBits::eTransferSrc,
-            indicies.data(),
-        };
-
         _indices_buffer = {
             _device,
             size,
             vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
         };
 
-        _device.copy_buffers(staging.buf(), _indices_buffer.buf(), size);
+        batch.upload(_indices_buffer, indicies.data(), size);
+    }
+
+    // every draw reads the uniforms, so they are copied from the ring into the frame's device
+    // local scratch once instead of each draw reading host memory when the ring is not in vram.
+    // the returned set is valid until the frame's context is reset
+    vk::DescriptorSet stage_uniforms(const vk::CommandBuffer& cb, common::frame_context& context, const uniform& ubo) {
+        const auto staged = _ring.push(&ubo, sizeof(ubo)).value();
+        const auto range = context.allocate_gpu(sizeof(ubo)).value();
+        vulkan::utils::copy_buffers(cb, staged.buffer, range.buffer, range.size, staged.offset, range.offset);
+
+        const vk::BufferMemoryBarrier barrier{
+            vk::AccessFlagBits::eTransferWrite,
+            vk::AccessFlagBits::eUniformRead,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            range.buffer,
+            range.offset,
+            range.size,
+        };
+        cb.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexShader, {}, {}, barrier, {});
+
+        const auto set = context.allocate_descriptor_set(*_descriptor_layout);
+        const vk::DescriptorBufferInfo dbi{range.buffer, range.offset, range.size};
+        const vk::WriteDescriptorSet wds{set, 0, 0, vk::DescriptorType::eUniformBuffer, {}, dbi};
+        _device.logical().updateDescriptorSets(wds, nullptr);
+        return set;
+    }
+
+    // everything a secondary buffer needs, nothing is inherited from the primary but the pass
+    void draw_range(const vk::CommandBuffer& cb, vk::DescriptorSet set, std::size_t begin, std::size_t end) const {
+        const vk::Viewport viewport{0.0f, 0.0f, (float)_swapchain.extent().width, (float)_swapchain.extent().height, 0.0f, 1.0f};
+        cb.bindPipeline(vk::PipelineBindPoint::eGraphics, *_pipeline);
+        cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *_pipeline_layout, 0, set, nullptr);
+        cb.bindVertexBuffers(0, _verticies_buffer.buf(), {0});
+        cb.bindIndexBuffer(_indices_buffer.buf(), 0, vk::IndexType::eUint32);
+        cb.setViewport(0, viewport);
+        cb.setScissor(0, vk::Rect2D{{0, 0}, _swapchain.extent()});
+
+        const auto side = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(_draws))));
+        const auto cell = 2.0f / side;
+        for (auto d = begin; d < end; ++d) {
+            const glm::vec4 transform{-1.0f + cell * (d % side + 0.5f), -1.0f + cell * (d / side + 0.5f), 1.0f / side, 0.0f};
+            cb.pushConstants<glm::vec4>(*_pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, transform);
+            cb.drawIndexed(3, 1, 0, 0, 0);
+        }
+    }
+
+    // cpu time to record a frame of draws with 1 to max_threads workers, nothing is submitted.
+    // replaces run(), the overlay is released at the end like run() does
+    void bench_recording(std::uint32_t max_threads, std::uint32_t frames) {
+        auto& context = _frames[0].context;
+        const auto& cb = context.command_buffer();
+        vk::ClearValue clear_values[] = {
+            vk::ClearColorValue{0.5f, 0.5f, 0.5f, 1.0f},
+            vk::ClearDepthStencilValue{1.0f, 0},
+        };
+        vk::RenderPassBeginInfo rpbi{_render_pass, _framebuffers[0], {{0, 0}, _swapchain.extent()}, clear_values};
+        vk::CommandBufferInheritanceInfo inheritance{_render_pass, 0, _framebuffers[0]};
+
+        const auto configured = _recorder.workers();
+        fmt::print("recording {} draws, {} frames per thread count\n", _draws, frames);
+        fmt::print("threads   ms/frame  speedup\n");
+        double single{};
+        for (std::uint32_t threads = 1; threads <= max_threads; ++threads) {
+            _recorder = common::parallel_recorder{_device, _graphic_queue_index, _frames_in_flight, threads};
+
+            const auto start = std::chrono::steady_clock::now();
+            for (std::uint32_t f = 0; f < frames; ++f) {
+                context.reset();
+                _ring.begin_frame(0);
+                cb.begin({});
+                const auto set = stage_uniforms(*cb, context, uniform{glm::mat4(1.0f), glm::mat4(1.0f), glm::mat4(1.0f)});
+                cb.beginRenderPass(rpbi, vk::SubpassContents::eSecondaryCommandBuffers);
+                _recorder.record(0, *cb, inheritance, _draws, [this, set](const vk::CommandBuffer& sb, std::size_t begin, std::size_t end) { draw_range(sb, set, begin, end); });
+                cb.endRenderPass();
+                cb.end();
+            }
+            const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+            single = threads == 1 ? ms : single;
+            fmt::print("{:7} {:10.3f} {:7.2f}x\n", threads, ms, single / ms);
+        }
+
+        _recorder = common::parallel_recorder{_device, _graphic_queue_index, _frames_in_flight, configured};
+        _device.logical().waitIdle();
+        _overlay.release();
     }
 
     void record(std::uint32_t i) {
-        const auto& cb = _frames[_current_frame].command_buffer;
+        auto& context = _frames[_current_frame].context;
+        const auto& cb = context.command_buffer();
         const auto time = current_time();
 
-        uniform ubo{
+        const uniform ubo{
             glm::rotate(glm::mat4(1.0f), time, glm::vec3(0.0f, 0.0f, 1.0f)),
             glm::mat4(1.0f),
             glm::mat4(1.0f),
         };
-        _uniform_buffer.copy(&ubo, sizeof(ubo));
 
         vk::ClearValue clear_values[] = {
             vk::ClearColorValue{0.5f, 0.5f, 0.5f, 1.0f},
             vk::ClearDepthStencilValue{1.0f, 0},
         };
         vk::RenderPassBeginInfo rpbi{_render_pass, _framebuffers[i], {{0, 0}, _swapchain.extent()}, clear_values};
-        vk::Viewport viewport{0.0f, 0.0f, (float)_swapchain.extent().width, (float)_swapchain.extent().height, 0.0f, 1.0f};
+        vk::CommandBufferInheritanceInfo inheritance{_render_pass, 0, _framebuffers[i]};
 
-        cb.reset();
-        cb.begin({});
-        cb.beginRenderPass(rpbi, vk::SubpassContents::eInline);
-        cb.bindPipeline(vk::PipelineBindPoint::eGraphics, _pipeline);
-        cb.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, _pipeline_layout, 0, {_descriptor_set}, nullptr);
-        cb.bindVertexBuffers(0, _verticies_buffer.buf(), {0});
-        cb.bindIndexBuffer(_indices_buffer.buf(), 0, vk::IndexType::eUint32);
-        cb.setViewport(0, viewport);
-        cb.setScissor(0, vk::Rect2D{{0, 0}, _swapchain.extent()});
-        cb.drawIndexed(3, 1, 0, 0, 0);
-        
-        const auto props = _device.physical().getQueueFamilyProperties();
+        // widgets are built here, the overlay only records its draw data on this thread as the tail
         _overlay.begin();
         _overlay.button("button");
         _overlay.text("text");
-        _overlay.draw(*cb);
+        _overlay.text(fmt::format("{} draws on {} recording threads", _draws, _recorder.workers()));
+        overlay_gpu_times();
+        overlay_frame_times();
 
+        cb.begin({});
+        _profiler.reset(*cb, _current_frame);
+        const auto set = stage_uniforms(*cb, context, ubo);
+
+        const auto pass = _profiler.begin(*cb, "render pass");
+        cb.beginRenderPass(rpbi, vk::SubpassContents::eSecondaryCommandBuffers);
+        _recorder.record(
+            _current_frame, *cb, inheritance, _draws,
+            [this, set](const vk::CommandBuffer& sb, std::size_t begin, std::size_t end) { draw_range(sb, set, begin, end); },
+            [this](const vk::CommandBuffer& sb) { _overlay.draw(sb); });
         cb.endRenderPass();
+        _profiler.end(*cb, pass);
         cb.end();
     }
 };
 
-int main() {
+int main(int argc, char** argv) {
     try {
-        triangle triangle{};
+        bool batched{true};
+        bool bench{false};
+        std::size_t draws{1};
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view arg{argv[i]};
+            if (arg == "--unbatched") {
+                batched = false;
+            } else if (arg == "--record-bench") {
+                bench = true;
+            } else if (arg == "--draws" && i + 1 < argc) {
+                draws = std::max(std::stoi(argv[++i]), 1);
+            }
+        }
+
+        const auto config = common::application_config::parse(argc, argv);
+        triangle triangle{batched, draws, config};
+
+        if (bench) {
+            triangle.bench_recording(std::max(std::thread::hardware_concurrency(), 1u), 100);
+            return 0;
+        }
 
         triangle.run();
 
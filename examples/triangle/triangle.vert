@@ -6,12 +6,17 @@ layout(binding = 0) uniform UBO {
     mat4 p;
 } ubo;
 
+// per draw placement, xy is the clip space offset and z the scale
+layout(push_constant) uniform Draw {
+    vec4 transform;
+} draw;
+
 layout(location = 0) in vec2 aPos;
 layout(location = 1) in vec3 aColor;
 
 layout(location = 0) out vec3 fragColor;
 
 void main() {
-    gl_Position = ubo.p * ubo.v * ubo.m * vec4(aPos, 0.0, 1.0);
+    gl_Position = ubo.p * ubo.v * ubo.m * vec4(aPos * draw.transform.z, 0.0, 1.0) + vec4(draw.transform.xy, 0.0, 0.0);
     fragColor = aColor;
 }